@@ -0,0 +1,127 @@
+#pragma once
+
+#include "bulk.h"
+
+#include <algorithm>
+#include <array>
+
+namespace oclur {
+    BulkMatcher::BulkMatcher(
+        Engine& engine, const TokenDefnMap& defns, TokenId token
+    ) {
+        auto found = std::find_if(defns.begin(), defns.end(), [&](auto& entry) {
+            return entry.second->id == token;
+        });
+
+        if (found == defns.end()) {
+            engine.report_fatal_error("no token has the id ", token);
+        }
+
+        auto nfa = NfaBuilder(engine).build(*found->second);
+
+        if (!nfa.counters.empty()) {
+            counted = std::move(nfa);
+            return;
+        }
+
+        std::vector<std::size_t> starts {nfa.start};
+        dfa = minimize_dfa(DfaBuilder(nfa, starts).build());
+
+        for (auto accepts : dfa.accepts) {
+            accepting.push_back(accepts != no_token);
+        }
+    }
+
+    std::vector<BulkMatch> BulkMatcher::match(
+        std::span<const std::string_view> inputs
+    ) const {
+        std::vector<BulkMatch> results(inputs.size());
+        match(inputs, results);
+        return results;
+    }
+
+    void BulkMatcher::match(
+        std::span<const std::string_view> inputs, std::span<BulkMatch> results
+    ) const {
+        if (!counted.counters.empty()) {
+            match_counted(inputs, results);
+            return;
+        }
+        match_interleaved(inputs, results);
+    }
+
+    // Inputs go through in groups, one byte of each per step. Lanes whose
+    // input ran out or died sit in the dead state, which never accepts and
+    // never leaves, so steps need no branches per lane and the group only
+    // stops once every lane is dead.
+    void BulkMatcher::match_interleaved(
+        std::span<const std::string_view> inputs, std::span<BulkMatch> results
+    ) const {
+        const auto start = dfa.starts[0];
+        const auto start_prefix = accepting[start] ? 0 : no_prefix;
+
+        for (std::size_t group = 0; 
+            group < inputs.size(); 
+            group += number_of_lanes
+        ) {
+            const auto width = std::min(number_of_lanes, inputs.size() - group);
+
+            std::array<const char*, number_of_lanes> data {};
+            std::array<std::size_t, number_of_lanes> lengths {};
+            std::array<StateId, number_of_lanes> states {};
+            std::array<std::size_t, number_of_lanes> longest {};
+
+            for (std::size_t lane = 0; lane < width; ++lane) {
+                data[lane] = inputs[group + lane].data();
+                lengths[lane] = inputs[group + lane].size();
+                states[lane] = (lengths[lane] > 0) ? start : Dfa::dead_state;
+                longest[lane] = start_prefix;
+            }
+
+            for (std::size_t position = 0;; ++position) {
+                StateId alive = 0;
+
+                for (std::size_t lane = 0; lane < number_of_lanes; ++lane) {
+                    auto in_range = position < lengths[lane];
+                    auto byte = in_range 
+                        ? static_cast<std::uint8_t>(data[lane][position]) 
+                        : 0;
+                    auto state = dfa.next(states[lane], byte);
+
+                    state = in_range ? state : Dfa::dead_state;
+                    longest[lane] = accepting[state] 
+                        ? position + 1 
+                        : longest[lane];
+                    states[lane] = state;
+                    alive |= state;
+                }
+
+                if (alive == Dfa::dead_state) {
+                    break;
+                }
+            }
+
+            for (std::size_t lane = 0; lane < width; ++lane) {
+                auto& result = results[group + lane];
+                result.longest_prefix = longest[lane];
+                result.full_match = (longest[lane] == lengths[lane]);
+            }
+        }
+    }
+
+    void BulkMatcher::match_counted(
+        std::span<const std::string_view> inputs, std::span<BulkMatch> results
+    ) const {
+        CountingMatcher matcher(counted);
+        CountingMatcher::Threads threads;
+
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            auto match = matcher.match(inputs[i], 0, counted.start, threads);
+            results[i] = {};
+            if (match.token != no_token) {
+                results[i].longest_prefix = match.length;
+                results[i].full_match = (match.length == inputs[i].size());
+            }
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "dfa.cpp"
+#include "counting.cpp"
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace oclur {
+    constexpr std::size_t no_prefix = std::numeric_limits<std::size_t>::max();
+
+    struct BulkMatch {
+        bool full_match {false};
+        std::size_t longest_prefix {no_prefix}; // in bytes
+    };
+
+    // Matches many short inputs against a single token definition. The
+    // definition gets a DFA of its own, so tokens that would win ties in a
+    // token set do not hide it.
+    //
+    // Inputs are run through the DFA several at a time, one byte of each
+    // per step: the table lookups of different inputs do not depend on
+    // each other, so their latencies overlap.
+    class BulkMatcher {
+    public:
+        BulkMatcher(Engine&, const TokenDefnMap&, TokenId);
+
+        void match(
+            std::span<const std::string_view>, std::span<BulkMatch>
+        ) const;
+
+        [[nodiscard]]
+        std::vector<BulkMatch> match(std::span<const std::string_view>) const;
+
+    private:
+        // Inputs in flight at once on the scalar path.
+        static constexpr std::size_t number_of_lanes = 8;
+
+        void match_interleaved(
+            std::span<const std::string_view>, std::span<BulkMatch>
+        ) const;
+        void match_counted(
+            std::span<const std::string_view>, std::span<BulkMatch>
+        ) const;
+
+        Dfa dfa;
+        std::vector<std::uint8_t> accepting; // per state
+        Nfa counted; // only set when the token needs counters
+    };
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include "counting.h"
+
+#include <algorithm>
+
+namespace oclur {
+    Match CountingMatcher::match(
+        std::string_view data, std::size_t offset, std::size_t start
+    ) const {
+        Threads threads;
+        return match(data, offset, start, threads);
+    }
+
+    Match CountingMatcher::match(
+        std::string_view data, 
+        std::size_t offset, 
+        std::size_t start, 
+        Threads& threads
+    ) const {
+        threads.loops.resize(nfa.counters.size());
+        for (auto& loop : threads.loops) {
+            loop.counting_set.clear();
+            loop.iterations = 0;
+            loop.seen = loop.matched = loop.advanced = 0;
+        }
+        if (threads.visited.size() != nfa.states.size()) {
+            threads.visited.assign(nfa.states.size(), 0);
+            threads.generation = 0;
+        }
+
+        threads.states.clear();
+        threads.states.push_back(start);
+        compute_closure(threads);
+
+        // A token that matches the empty string matches with length 0
+        // until something longer does.
+        Match match;
+        match.token = get_accepted_token(threads);
+        auto position = offset;
+
+        while (position < data.size()) {
+            auto byte = static_cast<std::uint8_t>(data[position]);
+            step(threads, byte, position + 1);
+            if (threads.states.empty()) {
+                break;
+            }
+
+            ++position;
+
+            if (auto token = get_accepted_token(threads); token != no_token) {
+                match.token = token;
+                match.length = position - offset;
+            }
+        }
+
+        match.scanned_end = position + 1;
+        return match;
+    }
+
+    ByteSet CountingMatcher::get_first_bytes(std::size_t start) const {
+        ByteSet bytes;
+        std::vector<bool> visited(nfa.states.size());
+        std::vector<std::size_t> pending {start};
+
+        while (!pending.empty()) {
+            auto state = pending.back();
+            pending.pop_back();
+
+            if (visited[state]) {
+                continue;
+            }
+            visited[state] = true;
+
+            bytes |= nfa.states[state].bytes;
+            for (auto next : nfa.states[state].epsilons) {
+                pending.push_back(next);
+            }
+        }
+
+        return bytes;
+    }
+
+    void CountingMatcher::compute_closure(Threads& threads) const {
+        // Marks from a generation ago would look current after a wrap.
+        if (++threads.generation == 0) {
+            std::fill(threads.visited.begin(), threads.visited.end(), 0);
+            threads.generation = 1;
+        }
+
+        auto& pending = threads.pending;
+        pending.swap(threads.states);
+        threads.states.clear();
+
+        while (!pending.empty()) {
+            auto state = pending.back();
+            pending.pop_back();
+
+            if (threads.visited[state] == threads.generation) {
+                continue;
+            }
+
+            const auto& nfa_state = nfa.states[state];
+
+            if (nfa_state.counter_role == CounterRole::Exit &&
+                !can_exit(threads, nfa_state.counter)
+            ) {
+                continue;
+            }
+
+            if (nfa_state.counter_role == CounterRole::Enter) {
+                auto& loop = threads.loops[nfa_state.counter];
+                if (loop.counting_set.empty() ||
+                    loop.counting_set.back() != loop.iterations
+                ) {
+                    loop.counting_set.push_back(loop.iterations);
+                }
+            }
+
+            threads.visited[state] = threads.generation;
+            threads.states.push_back(state);
+
+            for (auto next : nfa_state.epsilons) {
+                pending.push_back(next);
+            }
+        }
+    }
+
+    // `position` is the offset reached by the step, which tells the loops
+    // touched in this step from the others.
+    void CountingMatcher::step(
+        Threads& threads, std::uint8_t byte, std::size_t position
+    ) const {
+        auto& next = threads.next;
+        next.clear();
+        threads.seen_loops.clear();
+
+        for (auto state : threads.states) {
+            const auto& nfa_state = nfa.states[state];
+            auto matched = nfa_state.bytes.test(byte);
+
+            if (nfa_state.counter_role == CounterRole::Loop ||
+                nfa_state.counter_role == CounterRole::Body
+            ) {
+                auto& loop = threads.loops[nfa_state.counter];
+                if (loop.seen != position) {
+                    loop.seen = position;
+                    threads.seen_loops.push_back(nfa_state.counter);
+                }
+                if (matched) {
+                    loop.matched = position;
+                }
+            }
+
+            if (!matched) {
+                continue;
+            }
+
+            // Going back to the Loop state finishes an iteration.
+            const auto& target = nfa.states[nfa_state.next];
+            if (target.counter_role == CounterRole::Loop &&
+                !advance(threads, target.counter, position)
+            ) {
+                continue;
+            }
+
+            next.push_back(nfa_state.next);
+        }
+
+        // A loop none of whose states matched has no threads left in it.
+        for (auto counter : threads.seen_loops) {
+            auto& loop = threads.loops[counter];
+            if (loop.matched != position) {
+                loop.counting_set.clear();
+            }
+        }
+
+        threads.states.swap(next);
+        compute_closure(threads);
+    }
+
+    // Counts the iteration once per step however many states finish it, and
+    // drops the threads that have now run the loop too often. Returns
+    // whether any thread is left to go on.
+    bool CountingMatcher::advance(
+        Threads& threads, std::size_t counter, std::size_t position
+    ) const {
+        auto& loop = threads.loops[counter];
+
+        if (loop.advanced != position) {
+            loop.advanced = position;
+            ++loop.iterations;
+
+            const auto max = nfa.counters[counter].max;
+            while (!loop.counting_set.empty() &&
+                loop.iterations - loop.counting_set.front() > max
+            ) {
+                loop.counting_set.pop_front();
+            }
+        }
+
+        return !loop.counting_set.empty();
+    }
+
+    bool CountingMatcher::can_exit(
+        const Threads& threads, std::size_t counter
+    ) const {
+        const auto& loop = threads.loops[counter];
+        return !loop.counting_set.empty() &&
+            loop.iterations - loop.counting_set.front() >=
+                nfa.counters[counter].min;
+    }
+
+    TokenId CountingMatcher::get_accepted_token(const Threads& threads) const {
+        TokenId token = no_token;
+        for (auto state : threads.states) {
+            token = std::min(token, nfa.states[state].accepts);
+        }
+        return token;
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "nfa.cpp"
+
+#include <deque>
+#include <string_view>
+#include <vector>
+
+namespace oclur {
+    // The longest match an engine found at some offset, and one past the
+    // last byte it looked at to find it.
+    struct Match {
+        TokenId token {no_token};
+        std::size_t length {0};
+        std::size_t scanned_end {0};
+    };
+
+    // Simulates an NFA with counted repetitions directly. Every counter
+    // keeps a counting set: how many iterations its loop had run when each
+    // live thread entered it, so the counts of all threads advance together
+    // as the loop runs and the set stays sorted, oldest (largest count)
+    // first. Threads only enter or leave a loop between characters, and
+    // every thread decodes the input the same way, so those in a loop are
+    // always in step with each other.
+    class CountingMatcher {
+    public:
+        CountingMatcher(const Nfa& nfa)
+            : nfa(nfa) {}
+
+        struct Loop {
+            std::deque<std::size_t> counting_set;
+            std::size_t iterations {0};
+
+            // The step positions at which the loop last had a state, had
+            // one that matched, and finished an iteration.
+            std::size_t seen {0};
+            std::size_t matched {0};
+            std::size_t advanced {0};
+        };
+
+        // The live threads of a simulation. Reusing one across matches
+        // saves allocating them every time; it belongs to one thread.
+        struct Threads {
+            std::vector<std::size_t> states;
+            std::vector<std::size_t> next;
+            std::vector<std::size_t> pending;
+            std::vector<Loop> loops; // one per counter
+            std::vector<std::size_t> seen_loops;
+            std::vector<std::uint32_t> visited;
+            std::uint32_t generation {0};
+        };
+
+        [[nodiscard]]
+        Match match(std::string_view, std::size_t, std::size_t) const;
+        [[nodiscard]] Match match(
+            std::string_view, std::size_t, std::size_t, Threads&
+        ) const;
+
+        // The bytes a match from the start state can begin with. Counters
+        // are ignored, so some of them may fail anyway.
+        [[nodiscard]] ByteSet get_first_bytes(std::size_t) const;
+
+    private:
+        void compute_closure(Threads&) const;
+        void step(Threads&, std::uint8_t, std::size_t) const;
+
+        [[nodiscard]] bool advance(Threads&, std::size_t, std::size_t) const;
+        [[nodiscard]] bool can_exit(const Threads&, std::size_t) const;
+        [[nodiscard]] TokenId get_accepted_token(const Threads&) const;
+
+        const Nfa& nfa;
+    };
+}
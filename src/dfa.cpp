@@ -0,0 +1,589 @@
+#pragma once
+
+#include "dfa.h"
+
+#include <algorithm>
+#include <map>
+
+namespace oclur {
+    Dfa DfaBuilder::build() {
+        dfa = Dfa {};
+        compute_byte_classes();
+
+        const auto classes = dfa.number_of_classes;
+
+        StateSetTable table;
+        std::vector<Scratch> scratches(get_number_of_workers());
+
+        auto dead = table.intern({});
+        add_state(dead);
+
+        std::vector<StateSetTable::Entry*> level;
+
+        for (auto nfa_start : starts) {
+            StateSet start_set {nfa_start};
+            compute_closure(nfa, scratches[0], start_set);
+
+            auto start = table.intern(std::move(start_set));
+            if (start->second == unnumbered) {
+                add_state(start);
+                level.push_back(start);
+            }
+            dfa.starts.push_back(start->second);
+        }
+
+        while (!level.empty()) {
+            std::vector<StateSetTable::Entry*> targets(level.size() * classes);
+
+            parallel_for(level.size(), [&](std::size_t worker, std::size_t i) {
+                auto sets = move(scratches[worker], level[i]->first);
+                for (std::size_t c = 0; c < classes; ++c) {
+                    targets[i * classes + c] = sets[c].empty()
+                        ? dead
+                        : table.intern(std::move(sets[c]));
+                }
+            });
+
+            std::vector<StateSetTable::Entry*> next_level;
+
+            for (std::size_t i = 0; i < level.size(); ++i) {
+                for (std::size_t c = 0; c < classes; ++c) {
+                    auto target = targets[i * classes + c];
+                    if (target->second == unnumbered) {
+                        add_state(target);
+                        next_level.push_back(target);
+                    }
+                    dfa.transitions[level[i]->second * classes + c] = 
+                        target->second;
+                }
+            }
+
+            level = std::move(next_level);
+        }
+
+        return std::move(dfa);
+    }
+
+    StateId DfaBuilder::add_state(StateSetTable::Entry* entry) {
+        entry->second = static_cast<StateId>(dfa.accepts.size());
+        dfa.accepts.push_back(get_accepted_token(entry->first));
+        dfa.transitions.resize(
+            dfa.transitions.size() + dfa.number_of_classes,
+            Dfa::dead_state
+        );
+        return entry->second;
+    }
+
+    std::size_t NfaStateSetHash::operator()(const NfaStateSet& set) const {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (auto state : set) {
+            hash = (hash ^ state) * 1099511628211ull;
+        }
+        return static_cast<std::size_t>(hash ^ (hash >> 32));
+    }
+
+    DfaBuilder::StateSetTable::Entry* DfaBuilder::StateSetTable::intern(
+        StateSet&& set
+    ) {
+        auto hash = StateSetHash {}(set);
+        auto& shard = shards[hash % number_of_shards];
+
+        std::lock_guard lock(shard.mutex);
+        auto [entry, _] = shard.sets.try_emplace(std::move(set), unnumbered);
+        return &*entry;
+    }
+
+    std::size_t split_byte_classes(
+        const std::vector<ByteSet>& sets, 
+        std::array<std::uint8_t, 256>& byte_classes
+    ) {
+        std::array<std::size_t, 256> classes {};
+        std::size_t number_of_classes = 1;
+
+        for (const auto& set : sets) {
+            std::map<std::pair<std::size_t, bool>, std::size_t> split;
+            for (std::size_t byte = 0; byte < 256; ++byte) {
+                auto key = std::make_pair(classes[byte], set.test(byte));
+                auto [found, _] = split.insert({key, split.size()});
+                classes[byte] = found->second;
+            }
+            number_of_classes = split.size();
+        }
+
+        // Renumber classes by first occurrence so the mapping is canonical.
+        std::vector<int> renumbered(number_of_classes, -1);
+        int next_number = 0;
+        for (std::size_t byte = 0; byte < 256; ++byte) {
+            auto& number = renumbered[classes[byte]];
+            if (number < 0) {
+                number = next_number++;
+            }
+            byte_classes[byte] = static_cast<std::uint8_t>(number);
+        }
+
+        return number_of_classes;
+    }
+
+    // Bytes that no NFA transition tells apart share a class, which keeps
+    // the transition table narrow.
+    void DfaBuilder::compute_byte_classes() {
+        std::vector<ByteSet> distinct_sets;
+        for (const auto& state : nfa.states) {
+            if (state.bytes.none()) {
+                continue;
+            }
+            if (std::find(
+                    distinct_sets.begin(), distinct_sets.end(), state.bytes
+                ) == distinct_sets.end()
+            ) {
+                distinct_sets.push_back(state.bytes);
+            }
+        }
+
+        auto number_of_classes = split_byte_classes(
+            distinct_sets, dfa.byte_classes
+        );
+        dfa.number_of_classes = number_of_classes;
+
+        std::vector<std::uint8_t> class_representatives;
+        for (std::size_t byte = 0; byte < 256; ++byte) {
+            if (dfa.byte_classes[byte] == class_representatives.size()) {
+                class_representatives.push_back(byte);
+            }
+        }
+
+        state_classes.assign(nfa.states.size(), {});
+        for (std::size_t state = 0; state < nfa.states.size(); ++state) {
+            for (std::size_t c = 0; c < number_of_classes; ++c) {
+                if (nfa.states[state].bytes.test(class_representatives[c])) {
+                    state_classes[state].push_back(c);
+                }
+            }
+        }
+    }
+
+    void compute_closure(
+        const Nfa& nfa, ClosureScratch& scratch, NfaStateSet& set
+    ) {
+        auto& visited = scratch.visited;
+        if (visited.size() != nfa.states.size()) {
+            visited.assign(nfa.states.size(), 0);
+        }
+        auto generation = ++scratch.generation;
+
+        std::vector<std::size_t> pending(set.begin(), set.end());
+        set.clear();
+
+        while (!pending.empty()) {
+            auto state = pending.back();
+            pending.pop_back();
+
+            if (visited[state] == generation) {
+                continue;
+            }
+
+            visited[state] = generation;
+            set.push_back(state);
+
+            for (auto next : nfa.states[state].epsilons) {
+                pending.push_back(next);
+            }
+        }
+
+        std::sort(set.begin(), set.end());
+    }
+
+    // Computes the successor sets of a state for every byte class at once.
+    std::vector<DfaBuilder::StateSet> DfaBuilder::move(
+        Scratch& scratch, const StateSet& set
+    ) const {
+        std::vector<StateSet> targets(dfa.number_of_classes);
+        for (auto state : set) {
+            for (auto c : state_classes[state]) {
+                targets[c].push_back(nfa.states[state].next);
+            }
+        }
+        for (auto& target : targets) {
+            if (!target.empty()) {
+                compute_closure(nfa, scratch, target);
+            }
+        }
+        return targets;
+    }
+
+    TokenId DfaBuilder::get_accepted_token(const StateSet& set) const {
+        TokenId token = no_token;
+        for (auto state : set) {
+            token = std::min(token, nfa.states[state].accepts);
+        }
+        return token;
+    }
+
+    std::size_t IncrementalDfaBuilder::link(const Nfa& fragment) {
+        auto first = nfa.states.size();
+        auto start = append_nfa(
+            nfa, fragment, static_cast<TokenId>(first + fragment.start)
+        );
+
+        Region region {first, nfa.states.size(), {}};
+        byte_sets.of_state.resize(nfa.states.size(), no_byte_set);
+
+        for (auto state = first; state < nfa.states.size(); ++state) {
+            const auto& bytes = nfa.states[state].bytes;
+            if (bytes.none()) {
+                continue;
+            }
+
+            auto [found, inserted] = byte_sets.ids.insert(
+                {bytes, static_cast<std::uint32_t>(byte_sets.sets.size())}
+            );
+            if (inserted) {
+                byte_sets.sets.push_back(bytes);
+                byte_sets.classes.emplace_back();
+            }
+
+            byte_sets.of_state[state] = found->second;
+            region.byte_sets.push_back(found->second);
+        }
+
+        std::sort(region.byte_sets.begin(), region.byte_sets.end());
+        region.byte_sets.erase(
+            std::unique(region.byte_sets.begin(), region.byte_sets.end()),
+            region.byte_sets.end()
+        );
+
+        regions.insert({start, std::move(region)});
+        return start;
+    }
+
+    void IncrementalDfaBuilder::unlink(std::size_t start) {
+        auto found = regions.find(start);
+        if (found == regions.end()) {
+            return;
+        }
+
+        const auto& region = found->second;
+        for (auto state = region.first; state < region.last; ++state) {
+            nfa.states[state] = NfaState {};
+            byte_sets.of_state[state] = no_byte_set;
+        }
+        number_of_unlinked_states += region.last - region.first;
+        regions.erase(found);
+    }
+
+    std::size_t IncrementalDfaBuilder::get_number_of_linked_states() const {
+        return nfa.states.size() - number_of_unlinked_states;
+    }
+
+    std::size_t IncrementalDfaBuilder::get_number_of_unlinked_states() const {
+        return number_of_unlinked_states;
+    }
+
+    std::size_t IncrementalDfaBuilder::get_number_of_explored_sets() const {
+        return number_of_explored_sets;
+    }
+
+    // Classes are split by the byte sets of the fragments the build uses,
+    // as DfaBuilder would split them, not by everything still linked.
+    void IncrementalDfaBuilder::update_byte_classes(
+        const std::vector<std::vector<Link>>& modes
+    ) {
+        std::vector<bool> used(byte_sets.sets.size());
+        for (const auto& links : modes) {
+            for (const auto& link : links) {
+                for (auto id : regions.at(link.start).byte_sets) {
+                    used[id] = true;
+                }
+            }
+        }
+
+        std::vector<ByteSet> used_sets;
+        for (std::size_t id = 0; id < byte_sets.sets.size(); ++id) {
+            if (used[id]) {
+                used_sets.push_back(byte_sets.sets[id]);
+            }
+        }
+
+        std::array<std::uint8_t, 256> classes;
+        auto number = split_byte_classes(used_sets, classes);
+
+        std::vector<std::uint8_t> class_representatives;
+        for (std::size_t byte = 0; byte < 256; ++byte) {
+            if (classes[byte] == class_representatives.size()) {
+                class_representatives.push_back(byte);
+            }
+        }
+
+        // A set this build reaches was reached by the last one too, or it
+        // would have been dropped, so the old classes told apart every byte
+        // its states do: its move on a new class is its move on the old
+        // class of any byte in it. Other sets get nonsense, but this build
+        // does not reach them either.
+        if (classes != byte_classes) {
+            for (auto& [_, explored] : sets) {
+                if (explored.moves.empty()) {
+                    continue;
+                }
+
+                std::vector<Entry*> moves(number);
+                for (std::size_t c = 0; c < number; ++c) {
+                    moves[c] = explored.moves[
+                        byte_classes[class_representatives[c]]
+                    ];
+                }
+                explored.moves = std::move(moves);
+            }
+
+            byte_classes = classes;
+            number_of_classes = number;
+        }
+
+        for (std::size_t id = 0; id < byte_sets.sets.size(); ++id) {
+            auto& set_classes = byte_sets.classes[id];
+            set_classes.clear();
+            for (std::size_t c = 0; c < number; ++c) {
+                if (byte_sets.sets[id].test(class_representatives[c])) {
+                    set_classes.push_back(c);
+                }
+            }
+        }
+    }
+
+    // States are numbered breadth first in (state, class) order, as
+    // DfaBuilder numbers them, whether or not they had to be explored.
+    Dfa IncrementalDfaBuilder::build(
+        const std::vector<std::vector<Link>>& modes
+    ) {
+        update_byte_classes(modes);
+        scratches.resize(get_number_of_workers());
+
+        const auto classes = number_of_classes;
+        const auto build = ++number_of_builds;
+        number_of_explored_sets = 0;
+
+        std::vector<TokenId> tokens(nfa.states.size(), no_token); // by start
+        std::vector<Entry*> states;
+
+        auto reach = [&](Entry* entry) {
+            auto& explored = entry->second;
+            if (explored.build != build) {
+                explored.build = build;
+                explored.number = static_cast<StateId>(states.size());
+                states.push_back(entry);
+            }
+            return explored.number;
+        };
+
+        Dfa dfa;
+        dfa.byte_classes = byte_classes;
+        dfa.number_of_classes = classes;
+
+        reach(intern({}));
+
+        for (const auto& links : modes) {
+            NfaStateSet start_set;
+            for (const auto& link : links) {
+                start_set.push_back(link.start);
+                tokens[link.start] = std::min(tokens[link.start], link.token);
+            }
+            compute_closure(nfa, scratches[0], start_set);
+            dfa.starts.push_back(reach(intern(std::move(start_set))));
+        }
+
+        for (std::size_t level = 0; level < states.size();) {
+            const auto end = states.size();
+
+            std::vector<Entry*> unexplored;
+            for (auto i = level; i < end; ++i) {
+                if (states[i]->second.moves.empty()) {
+                    unexplored.push_back(states[i]);
+                }
+            }
+            explore(unexplored);
+
+            for (auto i = level; i < end; ++i) {
+                for (std::size_t c = 0; c < classes; ++c) {
+                    reach(states[i]->second.moves[c]);
+                }
+            }
+            level = end;
+        }
+
+        dfa.transitions.resize(states.size() * classes);
+        dfa.accepts.resize(states.size(), no_token);
+
+        for (std::size_t state = 0; state < states.size(); ++state) {
+            const auto& explored = states[state]->second;
+            for (std::size_t c = 0; c < classes; ++c) {
+                dfa.transitions[state * classes + c] = 
+                    explored.moves[c]->second.number;
+            }
+            for (auto start : explored.accepts) {
+                dfa.accepts[state] = 
+                    std::min(dfa.accepts[state], tokens[start]);
+            }
+        }
+
+        std::erase_if(sets, [&](const auto& entry) {
+            return entry.second.build != build;
+        });
+
+        return dfa;
+    }
+
+    // Moves are computed in parallel and interned afterwards; only new
+    // sets need their accepting fragments collected.
+    void IncrementalDfaBuilder::explore(const std::vector<Entry*>& entries) {
+        const auto classes = number_of_classes;
+        std::vector<std::vector<NfaStateSet>> targets(entries.size());
+
+        parallel_for(entries.size(), [&](std::size_t worker, std::size_t i) {
+            auto& successors = targets[i];
+            successors.resize(classes);
+
+            for (auto state : entries[i]->first) {
+                auto id = byte_sets.of_state[state];
+                if (id == no_byte_set) {
+                    continue;
+                }
+                for (auto c : byte_sets.classes[id]) {
+                    successors[c].push_back(nfa.states[state].next);
+                }
+            }
+            for (auto& set : successors) {
+                if (!set.empty()) {
+                    compute_closure(nfa, scratches[worker], set);
+                }
+            }
+        });
+
+        auto dead = intern({});
+
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            auto& moves = entries[i]->second.moves;
+            moves.resize(classes);
+            for (std::size_t c = 0; c < classes; ++c) {
+                moves[c] = targets[i][c].empty()
+                    ? dead
+                    : intern(std::move(targets[i][c]));
+            }
+        }
+
+        number_of_explored_sets += entries.size();
+    }
+
+    IncrementalDfaBuilder::Entry* IncrementalDfaBuilder::intern(
+        NfaStateSet&& set
+    ) {
+        auto [entry, inserted] = sets.try_emplace(std::move(set));
+        if (inserted) {
+            for (auto state : entry->first) {
+                if (nfa.states[state].accepts != no_token) {
+                    entry->second.accepts.push_back(nfa.states[state].accepts);
+                }
+            }
+        }
+        return &*entry;
+    }
+
+    // Moore-style partition refinement. Each round splits every block by
+    // the blocks its states' transitions lead to; blocks are refined
+    // independently and in parallel, then numbered by their first state so
+    // the result does not depend on scheduling.
+    Dfa minimize_dfa(const Dfa& dfa) {
+        const auto number_of_states = dfa.get_number_of_states();
+        const auto classes = dfa.number_of_classes;
+
+        std::vector<StateId> block(number_of_states);
+        std::size_t number_of_blocks = 0;
+        {
+            std::unordered_map<TokenId, StateId> initial;
+            for (std::size_t state = 0; state < number_of_states; ++state) {
+                auto [found, _] = initial.insert(
+                    {dfa.accepts[state], initial.size()}
+                );
+                block[state] = found->second;
+            }
+            number_of_blocks = initial.size();
+        }
+
+        while (true) {
+            std::vector<std::vector<StateId>> members(number_of_blocks);
+            for (std::size_t state = 0; state < number_of_states; ++state) {
+                members[block[state]].push_back(state);
+            }
+
+            // For every state, its part within its block; for every part,
+            // its first state.
+            std::vector<std::size_t> part(number_of_states);
+            std::vector<std::vector<StateId>> part_leaders(number_of_blocks);
+
+            parallel_for(number_of_blocks, [&](std::size_t, std::size_t b) {
+                std::map<std::vector<StateId>, std::size_t> parts;
+                std::vector<StateId> signature(classes);
+
+                for (auto state : members[b]) {
+                    for (std::size_t c = 0; c < classes; ++c) {
+                        signature[c] = block[
+                            dfa.transitions[state * classes + c]
+                        ];
+                    }
+                    auto [found, inserted] = parts.insert(
+                        {signature, parts.size()}
+                    );
+                    if (inserted) {
+                        part_leaders[b].push_back(state);
+                    }
+                    part[state] = found->second;
+                }
+            });
+
+            std::vector<std::pair<StateId, StateId>> leaders;
+            for (std::size_t b = 0; b < number_of_blocks; ++b) {
+                for (auto leader : part_leaders[b]) {
+                    leaders.push_back({leader, b});
+                }
+            }
+
+            if (leaders.size() == number_of_blocks) {
+                break;
+            }
+
+            std::sort(leaders.begin(), leaders.end());
+
+            std::vector<StateId> renumbered(number_of_states);
+            for (std::size_t i = 0; i < leaders.size(); ++i) {
+                renumbered[leaders[i].first] = i;
+            }
+
+            std::vector<StateId> refined(number_of_states);
+            parallel_for(number_of_states, [&](std::size_t, std::size_t state) {
+                auto leader = part_leaders[block[state]][part[state]];
+                refined[state] = renumbered[leader];
+            });
+
+            block = std::move(refined);
+            number_of_blocks = leaders.size();
+        }
+
+        Dfa minimized;
+        minimized.byte_classes = dfa.byte_classes;
+        minimized.number_of_classes = classes;
+        for (auto start : dfa.starts) {
+            minimized.starts.push_back(block[start]);
+        }
+        minimized.accepts.resize(number_of_blocks);
+        minimized.transitions.resize(number_of_blocks * classes);
+
+        for (auto state = number_of_states; state-- > 0;) {
+            auto b = block[state];
+            minimized.accepts[b] = dfa.accepts[state];
+            for (std::size_t c = 0; c < classes; ++c) {
+                minimized.transitions[b * classes + c] = 
+                    block[dfa.transitions[state * classes + c]];
+            }
+        }
+
+        return minimized;
+    }
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "nfa.cpp"
+#include "parallel.cpp"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace oclur {
+    using StateId = std::uint32_t;
+
+    // State 0 is the dead state: every transition out of it leads back to
+    // it, so the matcher only needs a single check per byte.
+    struct Dfa {
+        static constexpr StateId dead_state = 0;
+
+        std::array<std::uint8_t, 256> byte_classes {};
+        std::size_t number_of_classes {0};
+        std::vector<StateId> transitions; // [state * number_of_classes + class]
+        std::vector<TokenId> accepts;
+        std::vector<StateId> starts; // one per lexer mode
+
+        // Only set once a profile laid the states out: states below this
+        // carried nearly all of the profiled traffic. 0 when unprofiled.
+        std::size_t number_of_hot_states {0};
+
+        [[nodiscard]] std::size_t get_number_of_states() const {
+            return accepts.size();
+        }
+
+        [[nodiscard]] StateId next(StateId state, std::uint8_t byte) const {
+            return transitions[
+                state * number_of_classes + byte_classes[byte]
+            ];
+        }
+    };
+
+    // A sorted set of NFA states: what a DFA state stands for while the DFA
+    // is built.
+    using NfaStateSet = std::vector<std::size_t>;
+
+    struct NfaStateSetHash {
+        std::size_t operator()(const NfaStateSet&) const;
+    };
+
+    // Closure bookkeeping owned by one worker: a state has been visited
+    // when its mark equals the current generation.
+    struct ClosureScratch {
+        std::vector<std::uint32_t> visited;
+        std::uint32_t generation {0};
+    };
+
+    // Replaces a set of NFA states by its sorted epsilon closure.
+    void compute_closure(const Nfa&, ClosureScratch&, NfaStateSet&);
+
+    // Splits the bytes into classes that none of the sets tells apart,
+    // numbered by their first byte. Returns the number of classes.
+    std::size_t split_byte_classes(
+        const std::vector<ByteSet>&, std::array<std::uint8_t, 256>&
+    );
+
+    // Subset construction. States are explored one breadth-first level at a
+    // time: the successors of a level are computed in parallel, then
+    // numbered in (state, class) order, so the numbering matches a
+    // sequential build no matter how the work was scheduled.
+    //
+    // Every lexer mode has its own NFA start state, and all of them are
+    // determinized into one table, so state sets reachable from several
+    // modes are only stored once.
+    class DfaBuilder {
+    public:
+        DfaBuilder(const Nfa& nfa, const std::vector<std::size_t>& starts)
+            : nfa(nfa), starts(starts) {}
+
+        [[nodiscard]] Dfa build();
+
+    private:
+        using StateSet = NfaStateSet;
+        using StateSetHash = NfaStateSetHash;
+        using Scratch = ClosureScratch;
+
+        static constexpr StateId unnumbered = 
+            std::numeric_limits<StateId>::max();
+
+        // Deduplicates state sets found by concurrent workers. Each shard
+        // has its own lock; entries never move once inserted.
+        class StateSetTable {
+        public:
+            using Entry = std::pair<const StateSet, StateId>;
+
+            [[nodiscard]] Entry* intern(StateSet&&);
+
+        private:
+            static constexpr std::size_t number_of_shards = 64;
+
+            struct Shard {
+                std::mutex mutex;
+                std::unordered_map<StateSet, StateId, StateSetHash> sets;
+            };
+
+            std::array<Shard, number_of_shards> shards;
+        };
+
+        void compute_byte_classes();
+
+        [[nodiscard]] std::vector<StateSet> move(
+            Scratch&, const StateSet&
+        ) const;
+        [[nodiscard]] TokenId get_accepted_token(const StateSet&) const;
+        StateId add_state(StateSetTable::Entry*);
+
+        const Nfa& nfa;
+        const std::vector<std::size_t>& starts;
+        Dfa dfa;
+
+        // The byte classes each NFA state has a transition on.
+        std::vector<std::vector<std::uint8_t>> state_classes;
+    };
+
+    // Subset construction for an NFA that is edited between builds, as in
+    // watch mode. Fragments are linked into an NFA that only grows, and
+    // keep their states for as long as they are linked, so a set of NFA
+    // states means the same thing in every build. Explored sets and their
+    // moves are kept across builds: a build only explores sets it has not
+    // seen yet, which are the ones holding states of fragments linked since
+    // the last build. Sets the build no longer reaches are dropped.
+    //
+    // The accepting state of a fragment accepts the fragment's start state,
+    // which every build maps to a token.
+    class IncrementalDfaBuilder {
+    public:
+        // Links a fragment and returns its start state.
+        [[nodiscard]] std::size_t link(const Nfa&);
+        void unlink(std::size_t start);
+
+        struct Link {
+            std::size_t start; // of a linked fragment
+            TokenId token;
+        };
+
+        // Determinizes the given fragments, one list per lexer mode.
+        [[nodiscard]] Dfa build(const std::vector<std::vector<Link>>&);
+
+        // States of unlinked fragments are never reused; once they
+        // outnumber the linked ones, it is time for a new builder.
+        [[nodiscard]] std::size_t get_number_of_linked_states() const;
+        [[nodiscard]] std::size_t get_number_of_unlinked_states() const;
+
+        // The sets the last build had to explore.
+        [[nodiscard]] std::size_t get_number_of_explored_sets() const;
+
+    private:
+        struct Explored;
+        using Entry = std::pair<const NfaStateSet, Explored>;
+
+        struct Explored {
+            std::vector<Entry*> moves; // per byte class; empty if unexplored
+            std::vector<TokenId> accepts; // the fragments it accepts
+            std::size_t build {0}; // the last build that reached it
+            StateId number {0}; // in that build
+        };
+
+        struct Region {
+            std::size_t first;
+            std::size_t last;
+            std::vector<std::uint32_t> byte_sets; // distinct ones
+        };
+
+        static constexpr std::uint32_t no_byte_set = 
+            std::numeric_limits<std::uint32_t>::max();
+
+        void update_byte_classes(const std::vector<std::vector<Link>>&);
+        void explore(const std::vector<Entry*>&);
+        [[nodiscard]] Entry* intern(NfaStateSet&&);
+
+        Nfa nfa;
+        std::unordered_map<std::size_t, Region> regions; // by start state
+        std::size_t number_of_unlinked_states {0};
+
+        // The distinct byte sets of the NFA, and the byte classes each of
+        // them has a transition on.
+        struct {
+            std::unordered_map<ByteSet, std::uint32_t> ids;
+            std::vector<ByteSet> sets;
+            std::vector<std::vector<std::uint8_t>> classes;
+            std::vector<std::uint32_t> of_state; // no_byte_set if none
+        } byte_sets;
+
+        std::array<std::uint8_t, 256> byte_classes {};
+        std::size_t number_of_classes {1};
+
+        std::unordered_map<NfaStateSet, Explored, NfaStateSetHash> sets;
+        std::size_t number_of_builds {0};
+        std::size_t number_of_explored_sets {0};
+        std::vector<ClosureScratch> scratches;
+    };
+
+    // Merges equivalent states, across modes as well. The dead state stays
+    // state 0 and states keep the relative order of their first member.
+    [[nodiscard]] Dfa minimize_dfa(const Dfa&);
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "encoding.h"
+
+#include <algorithm>
+#include <bit>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace oclur {
+    StateId EncodedDfa::next(StateId state, std::uint8_t byte) const {
+        auto byte_class = byte_classes[byte];
+
+        if (state < number_of_dense_states) {
+            return dense[state * number_of_classes + byte_class];
+        }
+
+        const auto& encoded = states[state - number_of_dense_states];
+        if (encoded.encoding == StateEncoding::Single) {
+            return (byte_class == encoded.single_class) 
+                ? encoded.index 
+                : encoded.fallback;
+        }
+        return find_sparse(encoded, byte_class);
+    }
+
+    StateId EncodedDfa::find_sparse(
+        const EncodedState& encoded, std::uint8_t byte_class
+    ) const {
+#ifdef __SSE2__
+        auto classes = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(&sparse_classes[encoded.index])
+        );
+        auto matches = _mm_cmpeq_epi8(
+            classes, _mm_set1_epi8(static_cast<char>(byte_class))
+        );
+        auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(matches)) &
+            ((1u << encoded.count) - 1);
+
+        if (mask == 0) {
+            return encoded.fallback;
+        }
+        return sparse_targets[encoded.index + std::countr_zero(mask)];
+#else
+        for (std::size_t i = 0; i < encoded.count; ++i) {
+            auto listed_class = sparse_classes[encoded.index + i];
+            if (listed_class == byte_class) {
+                return sparse_targets[encoded.index + i];
+            }
+            if (listed_class > byte_class) {
+                break;
+            }
+        }
+        return encoded.fallback;
+#endif
+    }
+
+    std::size_t EncodedDfa::get_table_size() const {
+        return states.size() * sizeof(EncodedState) +
+            dense.size() * sizeof(StateId) +
+            sparse_classes.size() +
+            sparse_targets.size() * sizeof(StateId);
+    }
+
+    // The most common target of a row; the dead state wins ties, then the
+    // lowest state.
+    StateId get_fallback(const StateId* row, std::size_t number_of_classes) {
+        std::vector<StateId> targets(row, row + number_of_classes);
+        std::sort(targets.begin(), targets.end());
+
+        StateId fallback = Dfa::dead_state;
+        std::size_t best = 0;
+
+        for (std::size_t i = 0; i < targets.size();) {
+            auto j = i;
+            while (j < targets.size() && targets[j] == targets[i]) {
+                ++j;
+            }
+            if (j - i > best) {
+                fallback = targets[i];
+                best = j - i;
+            }
+            i = j;
+        }
+
+        return fallback;
+    }
+
+    EncodedDfa encode_dfa(const Dfa& dfa) {
+        const auto number_of_states = dfa.get_number_of_states();
+        const auto number_of_classes = dfa.number_of_classes;
+        const auto profiled = dfa.number_of_hot_states > 0;
+
+        std::vector<bool> is_start(number_of_states);
+        for (auto start : dfa.starts) {
+            is_start[start] = true;
+        }
+
+        std::vector<StateEncoding> encodings(number_of_states);
+        std::vector<StateId> fallbacks(number_of_states);
+        std::vector<std::size_t> listed(number_of_states);
+
+        for (std::size_t state = 0; state < number_of_states; ++state) {
+            const auto* row = 
+                dfa.transitions.data() + state * number_of_classes;
+            auto fallback = get_fallback(row, number_of_classes);
+
+            for (std::size_t c = 0; c < number_of_classes; ++c) {
+                listed[state] += (row[c] != fallback);
+            }
+            fallbacks[state] = fallback;
+
+            auto hot = profiled
+                ? state < dfa.number_of_hot_states
+                : state == Dfa::dead_state || is_start[state] || 
+                    fallback == state || listed[state] >= dense_fan_out;
+
+            // A sparse entry costs a class byte and a target per transition.
+            auto sparse_is_smaller = listed[state] * (1 + sizeof(StateId)) < 
+                number_of_classes * sizeof(StateId);
+
+            if (hot) {
+                encodings[state] = StateEncoding::Dense;
+            }
+            else if (listed[state] == 1) {
+                encodings[state] = StateEncoding::Single;
+            }
+            else if (listed[state] <= sparse_limit && sparse_is_smaller) {
+                encodings[state] = StateEncoding::Sparse;
+            }
+            else {
+                encodings[state] = StateEncoding::Dense;
+            }
+        }
+
+        // The dead state is dense, and the first, so it stays state 0.
+        std::vector<StateId> new_state(number_of_states);
+        StateId next_state = 0;
+        for (auto dense : {true, false}) {
+            for (std::size_t state = 0; state < number_of_states; ++state) {
+                if ((encodings[state] == StateEncoding::Dense) == dense) {
+                    new_state[state] = next_state++;
+                }
+            }
+        }
+
+        EncodedDfa encoded;
+        encoded.byte_classes = dfa.byte_classes;
+        encoded.number_of_classes = number_of_classes;
+        encoded.accepts.resize(number_of_states);
+
+        for (std::size_t state = 0; state < number_of_states; ++state) {
+            encoded.accepts[new_state[state]] = dfa.accepts[state];
+        }
+        for (auto start : dfa.starts) {
+            encoded.starts.push_back(new_state[start]);
+        }
+
+        for (std::size_t state = 0; state < number_of_states; ++state) {
+            if (encodings[state] == StateEncoding::Dense) {
+                const auto* row = 
+                    dfa.transitions.data() + state * number_of_classes;
+                for (std::size_t c = 0; c < number_of_classes; ++c) {
+                    encoded.dense.push_back(new_state[row[c]]);
+                }
+                encoded.number_of_dense_states++;
+            }
+        }
+
+        for (std::size_t state = 0; state < number_of_states; ++state) {
+            if (encodings[state] == StateEncoding::Dense) {
+                continue;
+            }
+
+            const auto* row = 
+                dfa.transitions.data() + state * number_of_classes;
+            const auto fallback = fallbacks[state];
+
+            EncodedState encoded_state;
+            encoded_state.encoding = encodings[state];
+            encoded_state.fallback = new_state[fallback];
+
+            if (encodings[state] == StateEncoding::Sparse) {
+                encoded_state.count = static_cast<std::uint8_t>(listed[state]);
+                encoded_state.index = 
+                    static_cast<std::uint32_t>(encoded.sparse_targets.size());
+            }
+
+            for (std::size_t c = 0; c < number_of_classes; ++c) {
+                if (row[c] == fallback) {
+                    continue;
+                }
+                if (encodings[state] == StateEncoding::Single) {
+                    encoded_state.single_class = static_cast<std::uint8_t>(c);
+                    encoded_state.index = new_state[row[c]];
+                }
+                else {
+                    encoded.sparse_classes.push_back(
+                        static_cast<std::uint8_t>(c)
+                    );
+                    encoded.sparse_targets.push_back(new_state[row[c]]);
+                }
+            }
+
+            encoded.states.push_back(encoded_state);
+        }
+
+        // The last sparse state's 16-byte load may run past its classes.
+        encoded.sparse_classes.resize(
+            encoded.sparse_classes.size() + sparse_limit
+        );
+
+        return encoded;
+    }
+}
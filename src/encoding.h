@@ -0,0 +1,69 @@
+#pragma once
+
+#include "dfa.cpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace oclur {
+    // How the transitions out of one state are stored.
+    enum class StateEncoding : std::uint8_t {
+        Dense,  // a full row, one lookup per byte
+        Sparse, // the listed classes, sorted, and their targets
+        Single  // one listed class, stored in the state itself
+    };
+
+    // Sparse states are searched with a single 16-byte compare.
+    constexpr std::size_t sparse_limit = 16;
+
+    // Without a profile, states that branch to at least this many targets
+    // besides their fallback stay dense: the shared prefixes near the start
+    // states, which most tokens pass through.
+    constexpr std::size_t dense_fan_out = 4;
+
+    // A state that is not dense.
+    struct EncodedState {
+        StateEncoding encoding {StateEncoding::Sparse};
+        std::uint8_t count {0};        // Sparse: number of listed classes
+        std::uint8_t single_class {0}; // Single: the listed class
+        std::uint32_t index {0};       // Sparse: where the state's
+                                       // transitions start. Single: target
+        StateId fallback {Dfa::dead_state}; // target of unlisted classes
+    };
+
+    // The transitions of a DFA with each state stored in whichever encoding
+    // is smallest. Sparse and single states only list the classes that do
+    // not go to the state's most common target, its fallback: usually the
+    // dead state, or the identifier state for keyword prefixes.
+    //
+    // States are renumbered dense first, so the state id alone tells a
+    // dense state, and stepping out of one is a single table load. States
+    // the profile marked hot always stay dense; without a profile, so do
+    // start states, states that mostly loop back to themselves, such as
+    // identifier loops, and states with a high fan-out. The dead state
+    // stays state 0. Starts and accepts are kept in the new numbering.
+    struct EncodedDfa {
+        std::array<std::uint8_t, 256> byte_classes {};
+        std::size_t number_of_classes {0};
+        std::size_t number_of_dense_states {0};
+
+        std::vector<StateId> dense; // rows of the dense states
+        std::vector<EncodedState> states; // the others, after the dense ones
+        std::vector<std::uint8_t> sparse_classes; // padded for 16-byte loads
+        std::vector<StateId> sparse_targets;
+
+        std::vector<TokenId> accepts;
+        std::vector<StateId> starts; // one per lexer mode
+
+        [[nodiscard]] StateId next(StateId, std::uint8_t) const;
+
+        // Bytes taken by the transitions in this encoding.
+        [[nodiscard]] std::size_t get_table_size() const;
+
+    private:
+        [[nodiscard]]
+        StateId find_sparse(const EncodedState&, std::uint8_t) const;
+    };
+
+    [[nodiscard]] EncodedDfa encode_dfa(const Dfa&);
+}
@@ -78,9 +78,17 @@ namespace oclur {
     template <typename T, typename ...Args> 
     void Engine::report_fatal_error(const T& arg1, Args&&... args) {
         report_error(arg1, std::forward<Args>(args)...);
+
+        if (issues.fatal_errors_recoverable) {
+            throw FatalError {};
+        }
         quit(get_number_of_errors(), get_number_of_warnings());
     }
 
+    void Engine::set_fatal_errors_recoverable(bool recoverable) {
+        issues.fatal_errors_recoverable = recoverable;
+    }
+
     Engine::~Engine() {
         quit(get_number_of_errors(), get_number_of_warnings());
     }
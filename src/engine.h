@@ -10,6 +10,10 @@
 #include <iostream>
 
 namespace oclur {
+    // Thrown by report_fatal_error() instead of quitting while fatal errors
+    // are recoverable. The error has been reported by then.
+    struct FatalError {};
+
     class Engine {
     public:
         Engine() = default;
@@ -32,6 +36,10 @@ namespace oclur {
         template <typename T, typename ...Args> 
         void report_fatal_error(const T&, Args&&...);
 
+        // Long-running callers, like watch mode, recover from fatal errors
+        // by catching FatalError.
+        void set_fatal_errors_recoverable(bool);
+
     private:
         template <typename T>
         [[nodiscard]] 
@@ -57,6 +65,7 @@ namespace oclur {
         struct {
             std::size_t number_of_errors {0};
             std::size_t number_of_warnings {0};
+            bool fatal_errors_recoverable {false};
         } issues;
     };
 }
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "generator.h"
+
+namespace oclur {
+    template <typename T>
+    const T& Generator<T>::Iterator::operator*() const {
+        return generator->get_value();
+    }
+
+    template <typename T>
+    typename Generator<T>::Iterator& Generator<T>::Iterator::operator++() {
+        if (!generator->next()) {
+            generator = nullptr;
+        }
+        return *this;
+    }
+
+    template <typename T>
+    bool Generator<T>::Iterator::operator==(std::default_sentinel_t) const {
+        return generator == nullptr;
+    }
+
+    template <typename T>
+    Generator<T>::Generator(Generator&& other) noexcept
+        : handle(std::exchange(other.handle, nullptr)) {}
+
+    template <typename T>
+    Generator<T>& Generator<T>::operator=(Generator&& other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    template <typename T>
+    Generator<T>::~Generator() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    template <typename T>
+    bool Generator<T>::next() {
+        if (!handle || handle.done()) {
+            return false;
+        }
+        handle.resume();
+        return !handle.done();
+    }
+
+    template <typename T>
+    const T& Generator<T>::get_value() const {
+        return handle.promise().value;
+    }
+
+    template <typename T>
+    typename Generator<T>::Iterator Generator<T>::begin() {
+        Iterator iterator(this);
+        ++iterator;
+        return iterator;
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <utility>
+
+namespace oclur {
+    // A lazily evaluated sequence: the coroutine runs only when the next
+    // value is asked for and suspends again at each `co_yield`.
+    template <typename T>
+    class Generator {
+    public:
+        struct promise_type {
+            T value {};
+
+            Generator get_return_object() {
+                return Generator(Handle::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+
+            std::suspend_always yield_value(T yielded) {
+                value = std::move(yielded);
+                return {};
+            }
+
+            void return_void() {}
+            void unhandled_exception() { throw; }
+        };
+
+        using Handle = std::coroutine_handle<promise_type>;
+
+        class Iterator {
+        public:
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+
+            Iterator() = default;
+            Iterator(Generator* generator)
+                : generator(generator) {}
+
+            [[nodiscard]] const T& operator*() const;
+            Iterator& operator++();
+            void operator++(int) { ++*this; }
+
+            [[nodiscard]] bool operator==(std::default_sentinel_t) const;
+
+        private:
+            Generator* generator {nullptr};
+        };
+
+        Generator(Generator&&) noexcept;
+        Generator& operator=(Generator&&) noexcept;
+        Generator(const Generator&) = delete;
+        Generator& operator=(const Generator&) = delete;
+        ~Generator();
+
+        // Runs the coroutine up to its next value. Returns false once it
+        // has finished instead.
+        [[nodiscard]] bool next();
+
+        [[nodiscard]] const T& get_value() const;
+
+        // Starts the coroutine; iterating consumes the generator.
+        [[nodiscard]] Iterator begin();
+        [[nodiscard]] std::default_sentinel_t end() const { return {}; }
+
+    private:
+        explicit Generator(Handle handle)
+            : handle(handle) {}
+
+        Handle handle;
+    };
+}
@@ -0,0 +1,577 @@
+#pragma once
+
+#include "lexer.h"
+
+#include <algorithm>
+
+namespace oclur {
+    ModeStacks::ModeStacks() {
+        nodes.push_back({0, 0});
+    }
+
+    ModeStackId ModeStacks::push(ModeStackId stack, std::size_t mode) {
+        auto [found, inserted] = interned.insert(
+            {{stack, mode}, static_cast<ModeStackId>(nodes.size())}
+        );
+        if (inserted) {
+            nodes.push_back({stack, mode});
+        }
+        return found->second;
+    }
+
+    // Popping the initial mode leaves it in place.
+    ModeStackId ModeStacks::pop(ModeStackId stack) const {
+        return nodes[stack].parent;
+    }
+
+    std::size_t ModeStacks::get_mode(ModeStackId stack) const {
+        return nodes[stack].mode;
+    }
+
+    Token Lexer::match(
+        std::string_view data, std::size_t offset, std::size_t mode
+    ) const {
+        CountingMatcher::Threads threads;
+        return match(data, offset, mode, threads);
+    }
+
+    // A token that no counted token can start with never pays for the
+    // counted NFA. Like the DFA's, empty counted matches are ignored, since
+    // the lexer has to move on.
+    Token Lexer::match(
+        std::string_view data, 
+        std::size_t offset, 
+        std::size_t mode,
+        CountingMatcher::Threads& threads
+    ) const {
+        auto best = match_dfa(data, offset, mode);
+
+        if (token_set.has_counted_tokens() && offset < data.size() &&
+            token_set.counted_first_bytes[mode].test(
+                static_cast<std::uint8_t>(data[offset])
+            )
+        ) {
+            auto counted = CountingMatcher(token_set.counted).match(
+                data, offset, token_set.counted_starts[mode], threads
+            );
+
+            if (counted.token != no_token && counted.length > 0 && (
+                counted.length > best.length ||
+                (counted.length == best.length && counted.token < best.token)
+            )) {
+                best.token = counted.token;
+                best.length = counted.length;
+            }
+
+            best.scanned_end = std::max(best.scanned_end, counted.scanned_end);
+        }
+
+        Token token;
+        token.id = best.token;
+        token.offset = offset;
+        token.length = (best.token == no_token) ? 1 : best.length;
+        token.lookahead = best.scanned_end - (offset + token.length);
+
+        return token;
+    }
+
+    Match Lexer::match_dfa(
+        std::string_view data, std::size_t offset, std::size_t mode
+    ) const {
+        const auto& dfa = token_set.encoded;
+
+        Match match;
+        auto state = dfa.starts[mode];
+        auto position = offset;
+
+        while (position < data.size()) {
+            state = dfa.next(state, static_cast<std::uint8_t>(data[position]));
+            if (state == Dfa::dead_state) {
+                break;
+            }
+
+            ++position;
+
+            if (dfa.accepts[state] != no_token) {
+                match.token = dfa.accepts[state];
+                match.length = position - offset;
+            }
+        }
+
+        // `position` is the byte that killed the DFA, or the end of input;
+        // either way it was looked at.
+        match.scanned_end = position + 1;
+        return match;
+    }
+
+    ModeStackId Lexer::get_next_stack(
+        ModeStacks& stacks, const Token& token
+    ) const {
+        if (token.id == no_token) {
+            return token.stack;
+        }
+
+        const auto& action = token_set.actions[token.id];
+        switch (action.kind) {
+        case ModeAction::Push:
+            return stacks.push(token.stack, action.mode);
+        case ModeAction::Pop:
+            return stacks.pop(token.stack);
+        default:
+            return token.stack;
+        }
+    }
+
+    TokenList Lexer::tokenize(std::string_view data) const {
+        TokenList list;
+        std::vector<Token> tokens;
+        ModeStackId stack = 0;
+        CountingMatcher::Threads threads;
+
+        for (std::size_t offset = 0; offset < data.size();) {
+            auto token = match(
+                data, offset, list.stacks.get_mode(stack), threads
+            );
+            token.stack = stack;
+            stack = get_next_stack(list.stacks, token);
+            offset += token.length;
+            tokens.push_back(token);
+        }
+
+        list.replace(0, 0, tokens);
+        return list;
+    }
+
+    Generator<std::span<const Token>> Lexer::stream(
+        std::string_view data, std::size_t batch_size
+    ) const {
+        ModeStacks stacks;
+        ModeStackId stack = 0;
+        CountingMatcher::Threads threads;
+
+        std::vector<Token> batch;
+        batch.reserve(batch_size);
+
+        for (std::size_t offset = 0; offset < data.size();) {
+            auto token = match(data, offset, stacks.get_mode(stack), threads);
+            token.stack = stack;
+            stack = get_next_stack(stacks, token);
+            offset += token.length;
+            batch.push_back(token);
+
+            if (batch.size() == batch_size) {
+                co_yield std::span<const Token>(batch);
+                batch.clear();
+            }
+        }
+
+        if (!batch.empty()) {
+            co_yield std::span<const Token>(batch);
+        }
+    }
+
+    // The first token whose scan reached into the edit has to be re-lexed.
+    // Scans can run past several later tokens, so this is not necessarily
+    // the token the edit falls into.
+    std::size_t Lexer::find_first_affected(
+        const TokenList& list, const Edit& edit
+    ) const {
+        return list.find_first_scanning_past(edit.offset);
+    }
+
+    // Lexing restarts at the first affected token and stops as soon as a new
+    // token ends exactly where an old token past the edit begins, with the
+    // same mode stack: from there on the input and the lexer state are the
+    // same as before the edit.
+    //
+    // A restarted token that ends before the edit and comes out as before
+    // leaves the lexer where it was, so lexing skips ahead to the next token
+    // whose scan reached the edit. Otherwise one token scanning to the end
+    // of the input would have every later edit re-lex everything after it.
+    TokenChange Lexer::relex(
+        std::string_view data, TokenList& list, const Edit& edit
+    ) const {
+        TokenChange change;
+
+        std::size_t offset = 0;
+        ModeStackId stack = 0;
+
+        auto restart = [&](std::size_t first) {
+            change.first = first;
+            change.tokens.clear();
+
+            if (first < list.size()) {
+                auto token = list[first];
+                offset = token.offset;
+                stack = token.stack;
+            }
+            else if (!list.empty()) {
+                auto last = list[list.size() - 1];
+                offset = last.offset + last.length;
+                stack = get_next_stack(list.stacks, last);
+            }
+        };
+
+        restart(find_first_affected(list, edit));
+
+        auto edit_end = edit.offset + edit.inserted;
+        CountingMatcher::Threads threads;
+
+        while (offset < data.size()) {
+            auto token = match(
+                data, offset, list.stacks.get_mode(stack), threads
+            );
+            token.stack = stack;
+            stack = get_next_stack(list.stacks, token);
+            offset += token.length;
+            change.tokens.push_back(token);
+
+            if (offset <= edit.offset &&
+                change.first < list.size() &&
+                change.tokens.size() == 1
+            ) {
+                auto old = list[change.first];
+
+                if (old.id == token.id && old.length == token.length) {
+                    if (old.lookahead != token.lookahead) {
+                        change.lookaheads.push_back(
+                            {change.first, token.lookahead}
+                        );
+                    }
+                    restart(list.find_first_scanning_past(
+                        edit.offset, change.first + 1
+                    ));
+                    continue;
+                }
+            }
+
+            if (offset < edit_end) {
+                continue;
+            }
+
+            auto old_offset = offset - edit.inserted + edit.removed;
+            auto next_old = std::max(
+                change.first, list.find_first_starting_from(old_offset)
+            );
+
+            if (next_old < list.size()) {
+                auto old = list[next_old];
+                if (old.offset == old_offset && old.stack == stack) {
+                    change.removed = next_old - change.first;
+                    return change;
+                }
+            }
+        }
+
+        change.removed = list.size() - change.first;
+        return change;
+    }
+
+    void Lexer::apply(TokenList& list, const TokenChange& change) const {
+        for (auto [index, lookahead] : change.lookaheads) {
+            list.set_lookahead(index, lookahead);
+        }
+        list.replace(change.first, change.removed, change.tokens);
+    }
+
+    TokenList::TokenList() {
+        nodes.emplace_back();
+    }
+
+    std::size_t TokenList::size() const {
+        return nodes[root].count;
+    }
+
+    bool TokenList::empty() const {
+        return size() == 0;
+    }
+
+    Token TokenList::operator[](std::size_t index) const {
+        std::size_t offset = 0;
+        auto node = root;
+
+        while (true) {
+            const auto& current = nodes[node];
+            const auto& left = nodes[current.left];
+
+            if (index < left.count) {
+                node = current.left;
+                continue;
+            }
+
+            offset += left.bytes;
+
+            if (index == left.count) {
+                auto token = current.token;
+                token.offset = offset;
+                return token;
+            }
+
+            index -= left.count + 1;
+            offset += current.token.length;
+            node = current.right;
+        }
+    }
+
+    std::size_t TokenList::find_first_scanning_past(
+        std::size_t offset, std::size_t from
+    ) const {
+        return find_scanning_past(root, 0, 0, offset, from);
+    }
+
+    // Subtrees whose reach stops at or before the offset, or that lie
+    // entirely before `from`, are skipped whole.
+    std::size_t TokenList::find_scanning_past(
+        NodeId node,
+        std::size_t index,
+        std::size_t start,
+        std::size_t offset,
+        std::size_t from
+    ) const {
+        if (node == null_node) {
+            return size();
+        }
+
+        const auto& current = nodes[node];
+        if (start + current.reach <= offset || index + current.count <= from) {
+            return size();
+        }
+
+        auto found =
+            find_scanning_past(current.left, index, start, offset, from);
+        if (found != size()) {
+            return found;
+        }
+
+        const auto& left = nodes[current.left];
+
+        auto own = index + left.count;
+        auto end = start + left.bytes + current.token.length;
+        if (own >= from && end + current.token.lookahead > offset) {
+            return own;
+        }
+
+        return find_scanning_past(current.right, own + 1, end, offset, from);
+    }
+
+    std::size_t TokenList::find_first_starting_from(std::size_t offset) const {
+        std::size_t found = size();
+        std::size_t index = 0;
+        std::size_t start = 0;
+
+        for (auto node = root; node != null_node;) {
+            const auto& current = nodes[node];
+            const auto& left = nodes[current.left];
+            auto token_start = start + left.bytes;
+
+            if (token_start >= offset) {
+                found = index + left.count;
+                node = current.left;
+            }
+            else {
+                index += left.count + 1;
+                start = token_start + current.token.length;
+                node = current.right;
+            }
+        }
+
+        return found;
+    }
+
+    void TokenList::replace(
+        std::size_t first, std::size_t count, std::span<const Token> tokens
+    ) {
+        auto [before, rest] = split(root, first);
+        auto [removed, after] = split(rest, count);
+
+        release(removed);
+        root = merge(merge(before, build(tokens)), after);
+    }
+
+    void TokenList::set_lookahead(std::size_t index, std::size_t lookahead) {
+        std::vector<NodeId> path;
+
+        for (auto node = root;;) {
+            path.push_back(node);
+
+            auto& current = nodes[node];
+            auto left_count = nodes[current.left].count;
+
+            if (index < left_count) {
+                node = current.left;
+            }
+            else if (index == left_count) {
+                current.token.lookahead = lookahead;
+                break;
+            }
+            else {
+                index -= left_count + 1;
+                node = current.right;
+            }
+        }
+
+        for (auto node = path.rbegin(); node != path.rend(); ++node) {
+            update(*node);
+        }
+    }
+
+    std::vector<Token> TokenList::to_vector() const {
+        std::vector<Token> tokens;
+        tokens.reserve(size());
+
+        std::vector<NodeId> path;
+        std::size_t offset = 0;
+
+        for (auto node = root; node != null_node || !path.empty();) {
+            if (node != null_node) {
+                path.push_back(node);
+                node = nodes[node].left;
+                continue;
+            }
+
+            node = path.back();
+            path.pop_back();
+
+            auto token = nodes[node].token;
+            token.offset = offset;
+            offset += token.length;
+            tokens.push_back(token);
+
+            node = nodes[node].right;
+        }
+
+        return tokens;
+    }
+
+    TokenList::NodeId TokenList::make_node(const Token& token) {
+        // xorshift32; treap balance only needs the priorities to look random.
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+
+        Node node;
+        node.token = token;
+        node.token.offset = 0;
+        node.priority = seed;
+        node.count = 1;
+        node.bytes = token.length;
+        node.reach = token.length + token.lookahead;
+
+        if (!free_nodes.empty()) {
+            auto id = free_nodes.back();
+            free_nodes.pop_back();
+            nodes[id] = node;
+            return id;
+        }
+
+        nodes.push_back(node);
+        return static_cast<NodeId>(nodes.size() - 1);
+    }
+
+    void TokenList::release(NodeId tree) {
+        std::vector<NodeId> pending;
+        if (tree != null_node) {
+            pending.push_back(tree);
+        }
+
+        while (!pending.empty()) {
+            auto node = pending.back();
+            pending.pop_back();
+
+            for (auto child : {nodes[node].left, nodes[node].right}) {
+                if (child != null_node) {
+                    pending.push_back(child);
+                }
+            }
+            free_nodes.push_back(node);
+        }
+    }
+
+    void TokenList::update(NodeId node) {
+        auto& current = nodes[node];
+        current.count = 1 +
+            nodes[current.left].count + nodes[current.right].count;
+        current.bytes = current.token.length +
+            nodes[current.left].bytes + nodes[current.right].bytes;
+
+        const auto& left = nodes[current.left];
+        const auto& right = nodes[current.right];
+        auto end = left.bytes + current.token.length;
+        current.reach = std::max({
+            left.reach, end + current.token.lookahead, end + right.reach
+        });
+    }
+
+    // Builds the treap of a run of tokens in linear time, keeping the right
+    // spine on a stack: each new node adopts the spine nodes of lower
+    // priority as its left subtree.
+    TokenList::NodeId TokenList::build(std::span<const Token> tokens) {
+        std::vector<NodeId> spine;
+
+        for (const auto& token : tokens) {
+            auto node = make_node(token);
+            auto adopted = null_node;
+
+            while (!spine.empty() &&
+                nodes[spine.back()].priority < nodes[node].priority
+            ) {
+                adopted = spine.back();
+                spine.pop_back();
+                update(adopted);
+            }
+
+            nodes[node].left = adopted;
+            if (!spine.empty()) {
+                nodes[spine.back()].right = node;
+            }
+            spine.push_back(node);
+        }
+
+        for (auto node = spine.rbegin(); node != spine.rend(); ++node) {
+            update(*node);
+        }
+
+        return spine.empty() ? null_node : spine.front();
+    }
+
+    // Splits off the first `count` tokens.
+    std::pair<TokenList::NodeId, TokenList::NodeId> TokenList::split(
+        NodeId tree, std::size_t count
+    ) {
+        if (tree == null_node) {
+            return {null_node, null_node};
+        }
+
+        auto left_count = nodes[nodes[tree].left].count;
+
+        if (count <= left_count) {
+            auto [left, right] = split(nodes[tree].left, count);
+            nodes[tree].left = right;
+            update(tree);
+            return {left, tree};
+        }
+
+        auto [left, right] = split(nodes[tree].right, count - left_count - 1);
+        nodes[tree].right = left;
+        update(tree);
+        return {tree, right};
+    }
+
+    TokenList::NodeId TokenList::merge(NodeId left, NodeId right) {
+        if (left == null_node || right == null_node) {
+            return (left == null_node) ? right : left;
+        }
+
+        if (nodes[left].priority > nodes[right].priority) {
+            auto merged = merge(nodes[left].right, right);
+            nodes[left].right = merged;
+            update(left);
+            return left;
+        }
+
+        auto merged = merge(left, nodes[right].left);
+        nodes[right].left = merged;
+        update(right);
+        return right;
+    }
+}
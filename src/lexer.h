@@ -0,0 +1,189 @@
+#pragma once
+
+#include "tokenset.cpp"
+#include "generator.cpp"
+
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace oclur {
+    using ModeStackId = std::uint32_t;
+
+    // Mode stacks are interned as the nodes of a tree, so two stacks are
+    // equal exactly when their ids are. Node 0 holds just the initial mode.
+    class ModeStacks {
+    public:
+        ModeStacks();
+
+        [[nodiscard]] ModeStackId push(ModeStackId, std::size_t);
+        [[nodiscard]] ModeStackId pop(ModeStackId) const;
+        [[nodiscard]] std::size_t get_mode(ModeStackId) const;
+
+    private:
+        struct Node {
+            ModeStackId parent;
+            std::size_t mode;
+        };
+
+        std::vector<Node> nodes;
+        std::map<std::pair<ModeStackId, std::size_t>, ModeStackId> interned;
+    };
+
+    // Bytes that no token matches come out as single-byte tokens with id
+    // `no_token`.
+    struct Token {
+        TokenId id {no_token};
+        std::size_t offset {0};
+        std::size_t length {0};
+        ModeStackId stack {0}; // the mode stack the token was lexed with
+
+        // How far past the end of the token the DFA had to look before it
+        // could decide on the token. Reaching the end of the input counts
+        // as looking at one more byte, since appending could change it.
+        std::size_t lookahead {0};
+    };
+
+    // The tokens of a document, kept in a treap in document order. Nodes
+    // store token lengths and subtree totals but no offsets: a token's
+    // offset is the length of everything before it, so replacing a run of
+    // tokens shifts all later ones without touching them, and an edit costs
+    // time in proportion to the tokens it replaces, plus O(log n).
+    class TokenList {
+    public:
+        TokenList();
+
+        [[nodiscard]] std::size_t size() const;
+        [[nodiscard]] bool empty() const;
+
+        // The token at an index, with its offset filled in.
+        [[nodiscard]] Token operator[](std::size_t) const;
+
+        // Index of the first token at or after index `from` whose scan,
+        // lookahead included, reached past an offset, or size() if there is
+        // none.
+        [[nodiscard]] std::size_t find_first_scanning_past(
+            std::size_t offset, std::size_t from = 0
+        ) const;
+
+        // Index of the first token that starts at or after an offset, or
+        // size() if there is none.
+        [[nodiscard]] std::size_t find_first_starting_from(std::size_t) const;
+
+        // Replaces `count` tokens starting at index `first`. Their lengths
+        // have to add up to the same span of the document as before the
+        // edit moved it; the offsets of the given tokens are ignored.
+        void replace(
+            std::size_t first, std::size_t count, std::span<const Token>
+        );
+
+        void set_lookahead(std::size_t index, std::size_t lookahead);
+
+        [[nodiscard]] std::vector<Token> to_vector() const;
+
+        ModeStacks stacks;
+
+    private:
+        using NodeId = std::uint32_t;
+        static constexpr NodeId null_node = 0;
+
+        struct Node {
+            Token token;
+            std::uint32_t priority {0};
+            NodeId left {null_node};
+            NodeId right {null_node};
+            std::size_t count {0}; // tokens in the subtree
+            std::size_t bytes {0}; // bytes they cover
+
+            // How far past the start of the subtree its furthest scan got.
+            std::size_t reach {0};
+        };
+
+        [[nodiscard]] NodeId make_node(const Token&);
+        void release(NodeId);
+        void update(NodeId);
+
+        [[nodiscard]] std::size_t find_scanning_past(
+            NodeId,
+            std::size_t index,
+            std::size_t start,
+            std::size_t offset,
+            std::size_t from
+        ) const;
+
+        [[nodiscard]] NodeId build(std::span<const Token>);
+        [[nodiscard]] std::pair<NodeId, NodeId> split(NodeId, std::size_t);
+        [[nodiscard]] NodeId merge(NodeId, NodeId);
+
+        std::vector<Node> nodes; // nodes[0] is the empty tree
+        std::vector<NodeId> free_nodes;
+        NodeId root {null_node};
+        std::uint32_t seed {0x9e3779b9};
+    };
+
+    // `removed` bytes at `offset` were replaced with `inserted` new bytes.
+    struct Edit {
+        std::size_t offset {0};
+        std::size_t removed {0};
+        std::size_t inserted {0};
+    };
+
+    // `removed` old tokens starting at index `first` are replaced by
+    // `tokens`. Old tokens after them stay valid; their offsets move with
+    // the edit on their own. Old tokens before `first` whose scans reached
+    // the edit but that came out the same only get new lookaheads.
+    struct TokenChange {
+        std::size_t first {0};
+        std::size_t removed {0};
+        std::vector<Token> tokens;
+        std::vector<std::pair<std::size_t, std::size_t>> lookaheads;
+    };
+
+    constexpr std::size_t default_batch_size = 256;
+
+    class Lexer {
+    public:
+        Lexer(const TokenSet& token_set)
+            : token_set(token_set) {}
+
+        [[nodiscard]]
+        Token match(std::string_view, std::size_t, std::size_t) const;
+
+        [[nodiscard]] TokenList tokenize(std::string_view) const;
+
+        // Lexes on demand, a batch of up to `batch_size` tokens per
+        // resumption. Each batch is only valid until the next one is asked
+        // for. The input and the lexer have to outlive the generator, and
+        // the tokens' mode stacks belong to the generator.
+        [[nodiscard]] Generator<std::span<const Token>> stream(
+            std::string_view, std::size_t batch_size = default_batch_size
+        ) const;
+
+        // May add mode stacks to the list; its tokens are left untouched.
+        [[nodiscard]]
+        TokenChange relex(std::string_view, TokenList&, const Edit&) const;
+
+        void apply(TokenList&, const TokenChange&) const;
+
+    private:
+        [[nodiscard]] Token match(
+            std::string_view, 
+            std::size_t, 
+            std::size_t, 
+            CountingMatcher::Threads&
+        ) const;
+
+        [[nodiscard]]
+        Match match_dfa(std::string_view, std::size_t, std::size_t) const;
+
+        [[nodiscard]]
+        ModeStackId get_next_stack(ModeStacks&, const Token&) const;
+
+        [[nodiscard]]
+        std::size_t find_first_affected(const TokenList&, const Edit&) const;
+
+        const TokenSet& token_set;
+    };
+}
@@ -5,6 +5,11 @@ void quit(std::size_t, std::size_t);
 
 #include "engine.cpp"
 #include "parser.cpp"
+#include "lexer.cpp"
+#include "watch.cpp"
+#include "profile.cpp"
+#include "stream.cpp"
+#include "bulk.cpp"
 
 #include <iostream>
 
@@ -25,12 +30,45 @@ void quit(std::size_t number_of_errors, std::size_t number_of_warnings) {
 // @todo: use clargs
 // @todo: use memory-guard
 int main(int argc, char* const argv[]) {
-    (void)argc;
-    (void)argv;
-
     oclur::Engine engine;
+
+    if (argc > 2 && std::string_view(argv[1]) == "--watch") {
+        oclur::watch(engine, argv[2]);
+    }
+
     oclur::Parser parser(engine);
 
     auto defns = parser.parse_file("sample.txt");
     std::cout << defns.size() << " token(s) defined\n";
+
+    auto token_set = oclur::compile_token_set(engine, defns);
+    std::cout << token_set.dfa.get_number_of_states() << " state(s), "
+        << token_set.encoded.get_table_size() << " byte(s) of transitions\n";
+
+    // --train <corpus> <profile> records a profile of the compiled token
+    // set; --profile <profile> lays the token set out with one.
+    if (argc > 3 && std::string_view(argv[1]) == "--train") {
+        auto [fileread, corpus] = oclur::read_file(argv[2]);
+        if (!fileread) {
+            engine.report_fatal_error("could not open corpus '", argv[2], "'");
+        }
+
+        oclur::DfaProfiler profiler(token_set);
+        profiler.train(corpus);
+
+        if (!oclur::save_profile(argv[3], profiler.get_profile())) {
+            engine.report_fatal_error(
+                "could not write profile '", argv[3], "'"
+            );
+        }
+    }
+    else if (argc > 2 && std::string_view(argv[1]) == "--profile") {
+        auto [loaded, profile] = oclur::load_profile(argv[2]);
+        if (!loaded) {
+            engine.report_fatal_error("could not load profile '", argv[2], "'");
+        }
+
+        oclur::apply_profile(engine, token_set, profile);
+        std::cout << token_set.dfa.number_of_hot_states << " hot state(s)\n";
+    }
 }
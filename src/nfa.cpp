@@ -0,0 +1,366 @@
+#pragma once
+
+#include "nfa.h"
+
+#include <map>
+#include <set>
+#include <tuple>
+
+namespace oclur {
+    Nfa NfaBuilder::build(const TokenDefn& defn) {
+        nfa = Nfa {};
+        current_token = defn.name;
+
+        auto fragment = build_regex(defn.regex);
+        nfa.start = fragment.start;
+        nfa.states[fragment.end].accepts = defn.id;
+
+        return std::move(nfa);
+    }
+
+    std::size_t append_nfa(Nfa& nfa, const Nfa& fragment, TokenId token) {
+        auto base = nfa.states.size();
+        auto counter_base = nfa.counters.size();
+
+        nfa.counters.insert(
+            nfa.counters.end(),
+            fragment.counters.begin(),
+            fragment.counters.end()
+        );
+
+        for (auto state : fragment.states) {
+            state.next += base;
+            state.counter += counter_base;
+            for (auto& epsilon : state.epsilons) {
+                epsilon += base;
+            }
+            if (state.accepts != no_token) {
+                state.accepts = token;
+            }
+            nfa.states.push_back(std::move(state));
+        }
+
+        return fragment.start + base;
+    }
+
+    std::size_t NfaBuilder::add_state() {
+        nfa.states.emplace_back();
+        return nfa.states.size() - 1;
+    }
+
+    void NfaBuilder::add_epsilon(std::size_t from, std::size_t to) {
+        nfa.states[from].epsilons.push_back(to);
+    }
+
+    NfaBuilder::Fragment NfaBuilder::build_regex(const RegexPtr& regex) {
+        const auto min = regex->occurances.min;
+        const auto max = regex->occurances.max;
+
+        // Each unrolled copy of a character set takes at least two states.
+        if (max != 0 && 2 * max > unroll_limit) {
+            if (auto set = get_character_set(regex); set) {
+                return build_counted(*set, min, max);
+            }
+        }
+
+        auto start = add_state();
+        auto current = start;
+
+        // The first copy tells how large the others will be. It is what the
+        // definition spells out, so only the copies after it count against
+        // the limit, and an element that is not repeated never does.
+        const auto copies = (max == 0) ? min + 1 : max;
+        auto first_copy = true;
+
+        auto build_copy = [&]() {
+            auto before = nfa.states.size();
+            auto fragment = build_regex_once(regex);
+
+            auto copy_states = std::max<std::size_t>(
+                nfa.states.size() - before, 1
+            );
+            if (first_copy &&
+                copies > 1 &&
+                copies - 1 > max_unrolled_states / copy_states
+            ) {
+                engine.report_fatal_error(
+                    "in token '",
+                    current_token,
+                    "': a repetition would unroll to more than ",
+                    max_unrolled_states,
+                    " NFA states; only a repeated character or character "
+                    "group gets a counter instead"
+                );
+            }
+            first_copy = false;
+
+            return fragment;
+        };
+
+        for (std::size_t i = 0; i < min; ++i) {
+            auto fragment = build_copy();
+            add_epsilon(current, fragment.start);
+            current = fragment.end;
+        }
+
+        if (max == 0) {
+            auto loop = add_state();
+            add_epsilon(current, loop);
+
+            auto fragment = build_copy();
+            add_epsilon(loop, fragment.start);
+            add_epsilon(fragment.end, loop);
+
+            return {start, loop};
+        }
+
+        auto end = add_state();
+
+        for (std::size_t i = min; i < max; ++i) {
+            auto fragment = build_copy();
+            add_epsilon(current, end);
+            add_epsilon(current, fragment.start);
+            current = fragment.end;
+        }
+
+        add_epsilon(current, end);
+        return {start, end};
+    }
+
+    NfaBuilder::Fragment NfaBuilder::build_regex_once(const RegexPtr& regex) {
+        switch (regex->kind) {
+        case RegexKind::Grouping: {
+            auto grouping = std::static_pointer_cast<GroupingRegex>(regex);
+            return build_sequence(grouping->items);
+        }
+        case RegexKind::OneOf: {
+            if (auto set = get_character_set(regex); set) {
+                return build_character_set(*set);
+            }
+            auto oneof = std::static_pointer_cast<OneOfRegex>(regex);
+            return build_alternation(oneof->items);
+        }
+        case RegexKind::AnythingBut: {
+            auto set = get_character_set(regex);
+            if (!set) {
+                engine.report_fatal_error(
+                    "in token '",
+                    current_token,
+                    "': '^' can only be applied to a character or a "
+                    "character group"
+                );
+            }
+            return build_character_set(*set);
+        }
+        default:
+            return build_character_set(*get_character_set(regex));
+        }
+    }
+
+    NfaBuilder::Fragment NfaBuilder::build_character_set(
+        const CodePointSet& set
+    ) {
+        if (is_ascii(set)) {
+            return build_byte_set(get_ascii_bytes(set));
+        }
+        return build_utf8(set);
+    }
+
+    NfaBuilder::Fragment NfaBuilder::build_byte_set(const ByteSet& bytes) {
+        auto start = add_state();
+        auto end = add_state();
+
+        nfa.states[start].bytes = bytes;
+        nfa.states[start].next = end;
+
+        return {start, end};
+    }
+
+    // Every encoded sequence becomes a chain of byte-range states. Chains are
+    // built back to front and share any state with the same range and the
+    // same successor, so the long runs of full continuation-byte ranges that
+    // large sets produce are only built once.
+    NfaBuilder::Fragment NfaBuilder::build_utf8(const CodePointSet& set) {
+        auto start = add_state();
+        auto end = add_state();
+
+        add_utf8_sequences(set, start, end);
+        return {start, end};
+    }
+
+    void NfaBuilder::add_utf8_sequences(
+        const CodePointSet& set, std::size_t start, std::size_t end
+    ) {
+        using StateKey = std::tuple<std::uint8_t, std::uint8_t, std::size_t>;
+        std::map<StateKey, std::size_t> states;
+        std::set<std::size_t> first_states;
+
+        for (const auto& sequence : get_utf8_sequences(set)) {
+            auto next = end;
+
+            for (auto range = sequence.rbegin();
+                range != sequence.rend();
+                ++range
+            ) {
+                auto key = std::make_tuple(range->lower, range->upper, next);
+
+                if (auto found = states.find(key); found != states.end()) {
+                    next = found->second;
+                    continue;
+                }
+
+                auto state = add_state();
+                for (unsigned i = range->lower; i <= range->upper; ++i) {
+                    nfa.states[state].bytes.set(i);
+                }
+                nfa.states[state].next = next;
+
+                states.insert({key, state});
+                next = state;
+            }
+
+            if (first_states.insert(next).second) {
+                add_epsilon(start, next);
+            }
+        }
+    }
+
+    NfaBuilder::Fragment NfaBuilder::build_counted(
+        const CodePointSet& set, std::size_t min, std::size_t max
+    ) {
+        auto counter = nfa.counters.size();
+        nfa.counters.push_back({min, max});
+
+        auto enter = add_state();
+        auto loop = add_state();
+        auto exit = add_state();
+        auto end = add_state();
+
+        nfa.states[enter].counter_role = CounterRole::Enter;
+        nfa.states[loop].counter_role = CounterRole::Loop;
+        nfa.states[exit].counter_role = CounterRole::Exit;
+
+        for (auto state : {enter, loop, exit}) {
+            nfa.states[state].counter = counter;
+        }
+
+        if (is_ascii(set)) {
+            nfa.states[loop].bytes = get_ascii_bytes(set);
+            nfa.states[loop].next = loop;
+        }
+        else {
+            auto first_body = nfa.states.size();
+            add_utf8_sequences(set, loop, loop);
+
+            for (auto state = first_body; state < nfa.states.size(); ++state) {
+                nfa.states[state].counter_role = CounterRole::Body;
+                nfa.states[state].counter = counter;
+            }
+        }
+
+        add_epsilon(enter, loop);
+        add_epsilon(loop, exit);
+        add_epsilon(exit, end);
+
+        return {enter, end};
+    }
+
+    NfaBuilder::Fragment NfaBuilder::build_sequence(
+        const std::vector<RegexPtr>& items
+    ) {
+        auto start = add_state();
+        auto current = start;
+
+        for (const auto& item : items) {
+            auto fragment = build_regex(item);
+            add_epsilon(current, fragment.start);
+            current = fragment.end;
+        }
+
+        return {start, current};
+    }
+
+    NfaBuilder::Fragment NfaBuilder::build_alternation(
+        const std::vector<RegexPtr>& items
+    ) {
+        auto start = add_state();
+        auto end = add_state();
+
+        for (const auto& item : items) {
+            auto fragment = build_regex(item);
+            add_epsilon(start, fragment.start);
+            add_epsilon(fragment.end, end);
+        }
+
+        return {start, end};
+    }
+
+    // Returns the code points matched by a regex that always consumes
+    // exactly one character, or nothing if the regex is more complex than
+    // that.
+    std::optional<CodePointSet> NfaBuilder::get_character_set(
+        const RegexPtr& regex
+    ) const {
+        switch (regex->kind) {
+        case RegexKind::Character: {
+            auto character = std::static_pointer_cast<CharacterRegex>(regex);
+            return normalize_code_points(
+                {{character->value, character->value}}
+            );
+        }
+        case RegexKind::AnyCharacter: {
+            return normalize_code_points({{0, max_code_point}});
+        }
+        case RegexKind::CharacterRange: {
+            auto range = std::static_pointer_cast<CharacterRangeRegex>(regex);
+            return normalize_code_points(
+                {{range->lower_bound, range->upper_bound}}
+            );
+        }
+        case RegexKind::OneOf: {
+            auto oneof = std::static_pointer_cast<OneOfRegex>(regex);
+            CodePointSet set;
+            for (const auto& item : oneof->items) {
+                if (item->occurances.min != 1 || item->occurances.max != 1) {
+                    return std::nullopt;
+                }
+                auto item_set = get_character_set(item);
+                if (!item_set) {
+                    return std::nullopt;
+                }
+                set.insert(set.end(), item_set->begin(), item_set->end());
+            }
+            return normalize_code_points(std::move(set));
+        }
+        case RegexKind::AnythingBut: {
+            auto anythingbut =
+                std::static_pointer_cast<AnythingButRegex>(regex);
+            const auto& inner = anythingbut->regex;
+            if (inner->occurances.min != 1 || inner->occurances.max != 1) {
+                return std::nullopt;
+            }
+            auto inner_set = get_character_set(inner);
+            if (!inner_set) {
+                return std::nullopt;
+            }
+            return complement_code_points(*inner_set);
+        }
+        default:
+            return std::nullopt;
+        }
+    }
+
+    bool is_ascii(const CodePointSet& set) {
+        return set.empty() || set.back().upper < 0x80;
+    }
+
+    ByteSet get_ascii_bytes(const CodePointSet& set) {
+        ByteSet bytes;
+        for (const auto& range : set) {
+            for (auto i = range.lower; i <= range.upper; ++i) {
+                bytes.set(i);
+            }
+        }
+        return bytes;
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "engine.cpp"
+#include "tokendefn.h"
+#include "utf8.cpp"
+
+#include <bitset>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace oclur {
+    using TokenId = std::uint32_t;
+    constexpr TokenId no_token = std::numeric_limits<TokenId>::max();
+
+    using ByteSet = std::bitset<256>;
+
+    // Bounded repetitions are unrolled only while that takes fewer NFA
+    // states than this; larger repetitions of a character set get a counter.
+    // Anything else is unrolled, but a repetition whose copies beyond the
+    // first take more states than the square of it is an error.
+    constexpr std::size_t unroll_limit = 256;
+    constexpr std::size_t max_unrolled_states = unroll_limit * unroll_limit;
+
+    // Characters are code points, matched as their UTF-8 encodings: sets of
+    // ASCII characters are a single byte-set transition, anything larger a
+    // small automaton over the encoded bytes.
+    //
+    // A counted repetition S{min,max} of a character set S is an Enter
+    // state, a Loop state repeating S, and an Exit state that may only be
+    // passed once the loop has run at least `min` times. An ASCII set is
+    // matched by the Loop state itself; a larger one by Body states that
+    // spell out its encodings and lead back to the Loop state, so the
+    // counter steps once per character, not once per byte.
+    enum class CounterRole : std::uint8_t {
+        None,
+        Enter,
+        Loop,
+        Body,
+        Exit
+    };
+
+    struct NfaCounter {
+        std::size_t min {0};
+        std::size_t max {0};
+    };
+
+    // A Thompson state has at most one byte-set transition; everything else
+    // is expressed through epsilon transitions.
+    struct NfaState {
+        ByteSet bytes;
+        std::size_t next {0};
+        std::vector<std::size_t> epsilons;
+        TokenId accepts {no_token};
+
+        CounterRole counter_role {CounterRole::None};
+        std::size_t counter {0};
+    };
+
+    [[nodiscard]] bool is_ascii(const CodePointSet&);
+    [[nodiscard]] ByteSet get_ascii_bytes(const CodePointSet&);
+
+    struct Nfa {
+        std::vector<NfaState> states;
+        std::vector<NfaCounter> counters;
+        std::size_t start {0};
+    };
+
+    class NfaBuilder {
+    public:
+        NfaBuilder(Engine& engine)
+            : engine(engine) {}
+
+        [[nodiscard]] Nfa build(const TokenDefn&);
+
+    private:
+        struct Fragment {
+            std::size_t start;
+            std::size_t end;
+        };
+
+        [[nodiscard]] std::size_t add_state();
+        void add_epsilon(std::size_t, std::size_t);
+
+        [[nodiscard]] Fragment build_regex(const RegexPtr&);
+        [[nodiscard]] Fragment build_regex_once(const RegexPtr&);
+        [[nodiscard]] Fragment build_character_set(const CodePointSet&);
+        [[nodiscard]] Fragment build_byte_set(const ByteSet&);
+        [[nodiscard]] Fragment build_utf8(const CodePointSet&);
+        void add_utf8_sequences(const CodePointSet&, std::size_t, std::size_t);
+        [[nodiscard]] Fragment build_counted(
+            const CodePointSet&, std::size_t, std::size_t
+        );
+        [[nodiscard]] Fragment build_sequence(const std::vector<RegexPtr>&);
+        [[nodiscard]] Fragment build_alternation(const std::vector<RegexPtr>&);
+
+        [[nodiscard]]
+        std::optional<CodePointSet> get_character_set(const RegexPtr&) const;
+
+        Engine& engine;
+        Nfa nfa;
+        std::string current_token;
+    };
+
+    // Copies the states of `fragment` into `nfa`, accepting `token`, and
+    // returns where the fragment's start state ended up.
+    [[nodiscard]]
+    std::size_t append_nfa(Nfa& nfa, const Nfa& fragment, TokenId token);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace oclur {
+    std::size_t get_number_of_workers() {
+        static const std::size_t workers = std::max(
+            1u, std::thread::hardware_concurrency()
+        );
+        return workers;
+    }
+
+    template <typename Function>
+    void parallel_for(std::size_t count, Function&& body) {
+        auto workers = std::min(
+            get_number_of_workers(),
+            (count + parallel_grain - 1) / parallel_grain
+        );
+
+        if (workers <= 1) {
+            for (std::size_t i = 0; i < count; ++i) {
+                body(0, i);
+            }
+            return;
+        }
+
+        std::atomic<std::size_t> next {0};
+
+        auto run = [&](std::size_t worker) {
+            for (auto i = next++; i < count; i = next++) {
+                body(worker, i);
+            }
+        };
+
+        std::vector<std::jthread> threads;
+        for (std::size_t worker = 1; worker < workers; ++worker) {
+            threads.emplace_back(run, worker);
+        }
+        run(0);
+    }
+}
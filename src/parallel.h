@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+namespace oclur {
+    // Loops shorter than this are not worth handing to other threads.
+    constexpr std::size_t parallel_grain = 16;
+
+    [[nodiscard]] std::size_t get_number_of_workers();
+
+    // Calls `body(worker, i)` for every i in [0, count), spread over up to
+    // get_number_of_workers() threads. `worker` is a stable index below
+    // that number, for per-thread scratch space. Returns once all calls
+    // have finished; the order of the calls is unspecified.
+    template <typename Function>
+    void parallel_for(std::size_t count, Function&& body);
+}
@@ -25,19 +25,56 @@ namespace oclur {
         }
 
         source.data = std::move(filedata);
-        source.data_iter = std::begin(source.data);
+        source.text = source.data;
+        source.data_iter = std::begin(source.text);
+
+        get_next_char();
+    }
+
+    void Parser::initialize(
+        std::string_view data, 
+        std::size_t offset, 
+        const Location& location
+    ) {
+        source.file = location.file;
+        source.location = location;
+        source.location.column--; // undone by get_next_char()
+
+        source.data.clear();
+        source.text = data;
+        source.data_iter = std::begin(source.text) + offset;
 
         get_next_char();
     }
 
     bool Parser::file_ended() const {
-        return source.data_iter == std::end(source.data) || 
-            (get_current_char() == 0);
+        return get_current_char() == 0;
     }
 
     uint32_t Parser::get_next_char() {
-        source.current_char = *source.data_iter++;
+        if (source.data_iter == std::end(source.text)) {
+            source.current_char = 0;
+            return get_current_char();
+        }
+
+        // Definitions are UTF-8; every character is read as a code point.
+        auto offset = static_cast<std::size_t>(
+            source.data_iter - std::begin(source.text)
+        );
+        auto [code_point, length] = decode_utf8(source.text, offset);
+
         ++source.location;
+
+        if (length == 0) {
+            engine.report_fatal_error(
+                &source.location,
+                "invalid UTF-8 in input"
+            );
+        }
+
+        source.current_char = code_point;
+        source.current_offset = offset;
+        source.data_iter += length;
         return get_current_char();
     }
 
@@ -45,6 +82,13 @@ namespace oclur {
         return source.current_char;
     }
 
+    std::size_t Parser::get_current_offset() const {
+        if (file_ended()) {
+            return source.text.size();
+        }
+        return source.current_offset;
+    }
+
     void Parser::skip_whitespace() {
         while ((!file_ended()) && std::iswspace(get_current_char())) {
             if (match_char('\n')) {
@@ -74,7 +118,10 @@ namespace oclur {
 
     std::string Parser::char_to_string(uint32_t ch) const {
         std::ostringstream ss;
-        if (std::iswprint(ch)) {
+        if (ch >= 0x80) {
+            ss << encode_utf8(ch);
+        }
+        else if (std::iswprint(ch)) {
             ss << (char)ch;
         }
         else {
@@ -112,17 +159,29 @@ namespace oclur {
         while (!file_ended()) {
             skip_whitespace();
 
-            expect_char_and_skip('d');
-            expect_char_and_skip('e');
-            expect_char_and_skip('f');
+            if (file_ended()) {
+                break;
+            }
 
-            skip_inline_whitespace();
-            parse_defn();
+            for (auto& defn : parse_block()) {
+                add_token_defn(std::move(defn));
+            }
         }
 
         return get_token_defns();
     }
 
+    std::pair<std::vector<TokenDefnPtr>, std::size_t> Parser::parse_block_at(
+        std::string_view data, 
+        std::size_t offset, 
+        const Location& location
+    ) {
+        initialize(data, offset, location);
+        current_mode = initial_mode; // a failed parse may have left a mode
+        auto defns = parse_block();
+        return {std::move(defns), get_current_offset()};
+    }
+
     std::string Parser::parse_name() {
         std::string name;
         if (
@@ -181,8 +240,53 @@ namespace oclur {
         return 0;
     }
 
-    void Parser::parse_defn() {
-        std::string token_name;
+    std::vector<TokenDefnPtr> Parser::parse_block() {
+        if (match_char('m')) {
+            return parse_mode();
+        }
+        return {parse_defn()};
+    }
+
+    std::vector<TokenDefnPtr> Parser::parse_mode() {
+        expect_char_and_skip('m');
+        expect_char_and_skip('o');
+        expect_char_and_skip('d');
+        expect_char_and_skip('e');
+
+        skip_inline_whitespace();
+        current_mode = parse_required_name();
+
+        skip_whitespace();
+        expect_char_and_skip('{');
+        skip_whitespace();
+
+        std::vector<TokenDefnPtr> defns;
+
+        while (!match_char('}')) {
+            if (file_ended()) {
+                engine.report_fatal_error(
+                    &source.location,
+                    "expected '}' to close mode '",
+                    current_mode,
+                    "', but the file ended"
+                );
+            }
+
+            defns.push_back(parse_defn());
+            skip_whitespace();
+        }
+
+        get_next_char(); // skip '}'
+
+        current_mode = initial_mode;
+        return defns;
+    }
+
+    TokenDefnPtr Parser::parse_defn() {
+        expect_char_and_skip('d');
+        expect_char_and_skip('e');
+        expect_char_and_skip('f');
+
         skip_inline_whitespace();
 
         auto name = parse_required_name();
@@ -191,7 +295,7 @@ namespace oclur {
         auto defn = parse_defn_body();
         defn->name = std::move(name);
 
-        add_token_defn(defn);
+        return defn;
     }
 
     TokenDefnPtr Parser::parse_defn_body() {
@@ -199,6 +303,8 @@ namespace oclur {
         skip_whitespace();
 
         auto token_defn = std::make_shared<TokenDefn>();
+        token_defn->modes.push_back(current_mode);
+
         std::vector<RegexPtr> regexes;
 
         do {
@@ -213,10 +319,17 @@ namespace oclur {
             else if (valuekind == "regex") {
                 regexes.push_back(parse_regex_token_value());
             }
+            else if (valuekind == "mode") {
+                token_defn->modes.push_back(parse_required_name());
+            }
+            else if (valuekind == "action") {
+                parse_action(*token_defn);
+            }
             else {
                 engine.report_fatal_error(
                     &source.location,
-                    "expected 'value' or 'regex', but found: ",
+                    "expected 'value', 'regex', 'mode' or 'action', "
+                    "but found: ",
                     valuekind
                 );
             }
@@ -226,13 +339,47 @@ namespace oclur {
 
         get_next_char(); // skip '}'
 
+        if (regexes.empty()) {
+            engine.report_fatal_error(
+                &source.location,
+                "token has neither a 'value' nor a 'regex'"
+            );
+        }
+
         token_defn->regex = combine_regex(std::move(regexes));
         return token_defn;
     }
 
+    void Parser::parse_action(TokenDefn& defn) {
+        if (defn.action.kind != ModeAction::None) {
+            engine.report_fatal_error(
+                &source.location,
+                "a token can only have one action"
+            );
+        }
+
+        auto action = parse_required_name();
+
+        if (action == "push") {
+            skip_inline_whitespace();
+            defn.action.kind = ModeAction::Push;
+            defn.action.mode = parse_required_name();
+        }
+        else if (action == "pop") {
+            defn.action.kind = ModeAction::Pop;
+        }
+        else {
+            engine.report_fatal_error(
+                &source.location,
+                "expected 'push' or 'pop', but found: ",
+                action
+            );
+        }
+    }
+
     RegexPtr Parser::parse_raw_token_value() {
         expect_char_and_skip('"');
-        std::string string_value;
+        std::u32string string_value;
 
         while (!file_ended()) {
             if (!match_char('"')) {
@@ -267,6 +414,8 @@ namespace oclur {
     }
 
     void Parser::add_token_defn(TokenDefnPtr defn) {
+        defn->id = token_defns.size();
+
         if (auto [_, inserted] = token_defns.insert({defn->name, defn}); 
             inserted
         ) {
@@ -317,6 +466,11 @@ namespace oclur {
             break;
         }
         default:
+            if (get_current_char() >= 0x80) {
+                regex = parse_code_point_preceeded_regex();
+                break;
+            }
+
             auto temp = std::make_shared<CharacterRegex>();
             temp->value = get_current_char();
             get_next_char();
@@ -372,13 +526,13 @@ namespace oclur {
         get_next_char(); // skip '['
         auto regex = std::make_shared<OneOfRegex>();
 
-        while (!match_char(']')) {
+        while ((!file_ended()) && !match_char(']')) {
             regex->items.push_back(parse_regex());
             // @todo: check if the parsed regex is a character regex. There 
             // ... should be a function for this.
         }
 
-        get_next_char();
+        expect_char_and_skip(']');
         return regex;
     }
 
@@ -386,11 +540,11 @@ namespace oclur {
         get_next_char(); // skip '('
         std::vector<RegexPtr> regexes;
 
-        while (!match_char(')')) {
+        while ((!file_ended()) && !match_char(')')) {
             regexes.push_back(parse_regex());
         }
 
-        get_next_char();
+        expect_char_and_skip(')');
         return combine_regex(std::move(regexes));
     }
 
@@ -407,7 +561,7 @@ namespace oclur {
     }
 
     RegexPtr Parser::parse_digit_preceeded_regex() {
-        char ch = get_current_char();
+        auto ch = get_current_char();
         get_next_char();
 
         if (!match_char('-')) {
@@ -419,7 +573,7 @@ namespace oclur {
         get_next_char();
 
         auto regex = std::make_shared<CharacterRangeRegex>();
-        regex->lower_bound = ch - '0';
+        regex->lower_bound = ch;
         
         if (!std::iswdigit(get_current_char())) {
             engine.report_fatal_error(
@@ -429,7 +583,7 @@ namespace oclur {
             );
         }
 
-        regex->upper_bound = get_current_char() - '0';
+        regex->upper_bound = get_current_char();
         get_next_char();
 
         if (regex->upper_bound < regex->lower_bound) {
@@ -443,7 +597,7 @@ namespace oclur {
     }
 
     RegexPtr Parser::parse_letter_preceeded_regex() {
-        char ch = get_current_char();
+        auto ch = get_current_char();
         get_next_char();
 
         if (!match_char('-')) {
@@ -477,4 +631,41 @@ namespace oclur {
 
         return regex;
     }
+
+    // Characters past ASCII, such as 'α-ω', can be ranges of code points.
+    RegexPtr Parser::parse_code_point_preceeded_regex() {
+        auto ch = get_current_char();
+        get_next_char();
+
+        if (!match_char('-')) {
+            auto regex = std::make_shared<CharacterRegex>();
+            regex->value = ch;
+            return regex;
+        }
+
+        get_next_char();
+
+        auto regex = std::make_shared<CharacterRangeRegex>();
+        regex->lower_bound = ch;
+
+        if (get_current_char() < 0x80) {
+            engine.report_fatal_error(
+                &source.location,
+                "expected a non-ASCII character after '-', but found: ",
+                char_to_string(get_current_char())
+            );
+        }
+
+        regex->upper_bound = get_current_char();
+        get_next_char();
+
+        if (regex->upper_bound < regex->lower_bound) {
+            engine.report_fatal_error(
+                &source.location,
+                "invalid range. Max cannot be less than Min"
+            );
+        }
+
+        return regex;
+    }
 }
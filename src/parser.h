@@ -3,6 +3,7 @@
 #include "engine.cpp"
 #include "tokendefn.h"
 #include "regex.cpp"
+#include "utf8.cpp"
 
 #include <string_view>
 #include <iomanip>
@@ -15,11 +16,21 @@ namespace oclur {
 
         const TokenDefnMap& parse_file(std::string_view);
 
+        // Parses only the 'def' or 'mode' block that starts at the given
+        // offset of `data`, without adding its definitions to the parser's
+        // own. The location is that of the block's first character. Returns
+        // the definitions and the offset just past the block.
+        [[nodiscard]] std::pair<std::vector<TokenDefnPtr>, std::size_t> 
+        parse_block_at(
+            std::string_view data, std::size_t offset, const Location&
+        );
+
         [[nodiscard]]
         const TokenDefnMap& get_token_defns() const;
 
     private:
         void initialize(std::string_view);
+        void initialize(std::string_view, std::size_t, const Location&);
 
         [[nodiscard]]
         bool file_ended() const;
@@ -29,6 +40,9 @@ namespace oclur {
         [[nodiscard]]
         uint32_t get_current_char() const;
 
+        [[nodiscard]]
+        std::size_t get_current_offset() const;
+
         void skip_whitespace();
         void skip_inline_whitespace();
         void move_to_next_line();
@@ -48,8 +62,11 @@ namespace oclur {
         [[nodiscard]] std::uint64_t parse_integer();
         [[nodiscard]] std::uint64_t parse_required_integer();
 
-        void parse_defn();
+        [[nodiscard]] std::vector<TokenDefnPtr> parse_block();
+        [[nodiscard]] std::vector<TokenDefnPtr> parse_mode();
+        [[nodiscard]] TokenDefnPtr parse_defn();
         TokenDefnPtr parse_defn_body();
+        void parse_action(TokenDefn&);
 
         [[nodiscard]] RegexPtr parse_raw_token_value();
         [[nodiscard]] RegexPtr parse_regex_token_value();
@@ -60,18 +77,22 @@ namespace oclur {
         [[nodiscard]] RegexPtr parse_anythingbut_regex();
         [[nodiscard]] RegexPtr parse_digit_preceeded_regex();
         [[nodiscard]] RegexPtr parse_letter_preceeded_regex();
+        [[nodiscard]] RegexPtr parse_code_point_preceeded_regex();
 
         void add_token_defn(TokenDefnPtr);
 
         struct {
             std::string file;
             std::string data;
-            std::string::iterator data_iter;
+            std::string_view text;
+            std::string_view::iterator data_iter;
+            std::size_t current_offset {0};
             Location location;
             uint32_t current_char {1};
         } source;
 
         Engine& engine;
         TokenDefnMap token_defns;
+        std::string current_mode {initial_mode};
     };
 }
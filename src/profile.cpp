@@ -0,0 +1,261 @@
+#pragma once
+
+#include "profile.h"
+
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+
+namespace oclur {
+    constexpr std::string_view profile_magic = "oclurprf";
+
+    // FNV-1a over everything that determines how the DFA matches.
+    std::uint64_t get_fingerprint(const Dfa& dfa) {
+        std::uint64_t hash = 0xcbf29ce484222325;
+
+        auto mix = [&](std::uint64_t value) {
+            for (int i = 0; i < 8; ++i) {
+                hash ^= (value >> (8 * i)) & 0xff;
+                hash *= 0x100000001b3;
+            }
+        };
+
+        mix(dfa.number_of_classes);
+        for (auto byte_class : dfa.byte_classes) {
+            mix(byte_class);
+        }
+        for (auto state : dfa.transitions) {
+            mix(state);
+        }
+        for (auto token : dfa.accepts) {
+            mix(token);
+        }
+        for (auto start : dfa.starts) {
+            mix(start);
+        }
+
+        return hash;
+    }
+
+    DfaProfiler::DfaProfiler(const TokenSet& token_set)
+        : token_set(token_set) {
+        const auto& dfa = token_set.dfa;
+
+        profile.fingerprint = get_fingerprint(dfa);
+        profile.number_of_classes = dfa.number_of_classes;
+        profile.visits.assign(dfa.get_number_of_states(), 0);
+        profile.transitions.assign(dfa.transitions.size(), 0);
+    }
+
+    // Each token's scan is replayed exactly as Lexer::match_dfa runs it,
+    // including the final step into the dead state.
+    void DfaProfiler::train(std::string_view corpus) {
+        const auto& dfa = token_set.dfa;
+        auto list = Lexer(token_set).tokenize(corpus);
+
+        for (const auto& token : list.to_vector()) {
+            auto state = dfa.starts[list.stacks.get_mode(token.stack)];
+            ++profile.visits[state];
+
+            for (auto position = token.offset;
+                position < corpus.size();
+                ++position
+            ) {
+                auto byte = static_cast<std::uint8_t>(corpus[position]);
+                auto index =
+                    state * dfa.number_of_classes + dfa.byte_classes[byte];
+
+                ++profile.transitions[index];
+                state = dfa.transitions[index];
+                ++profile.visits[state];
+
+                if (state == Dfa::dead_state) {
+                    break;
+                }
+            }
+        }
+    }
+
+    const DfaProfile& DfaProfiler::get_profile() const {
+        return profile;
+    }
+
+    bool save_profile(std::string_view filepath, const DfaProfile& profile) {
+        std::ofstream os(filepath.data(), std::ios::binary);
+
+        if (!os.is_open()) {
+            return false;
+        }
+
+        auto write = [&](std::uint64_t value) {
+            os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+
+        os.write(profile_magic.data(), profile_magic.size());
+        write(profile.fingerprint);
+        write(profile.number_of_classes);
+        write(profile.visits.size());
+
+        for (auto count : profile.visits) {
+            write(count);
+        }
+        for (auto count : profile.transitions) {
+            write(count);
+        }
+
+        return os.good();
+    }
+
+    std::pair<bool, DfaProfile> load_profile(std::string_view filepath) {
+        auto [fileread, filedata] = read_file(filepath);
+
+        if (!fileread || !filedata.starts_with(profile_magic)) {
+            return {false, {}};
+        }
+
+        auto position = profile_magic.size();
+
+        auto read = [&](std::uint64_t& value) {
+            if (position + sizeof(value) > filedata.size()) {
+                return false;
+            }
+            std::copy_n(
+                filedata.data() + position,
+                sizeof(value),
+                reinterpret_cast<char*>(&value)
+            );
+            position += sizeof(value);
+            return true;
+        };
+
+        DfaProfile profile;
+        std::uint64_t number_of_classes = 0;
+        std::uint64_t number_of_states = 0;
+
+        if (!read(profile.fingerprint) ||
+            !read(number_of_classes) ||
+            !read(number_of_states)
+        ) {
+            return {false, {}};
+        }
+
+        // Guards the allocations below against a corrupt header. Each
+        // factor is bounded before they are multiplied, so the product
+        // cannot wrap around: there are at most 256 byte classes, and
+        // every state needs a count left in the file.
+        const auto remaining = 
+            (filedata.size() - position) / sizeof(std::uint64_t);
+        if (number_of_classes > 256 || 
+            number_of_states > remaining ||
+            number_of_states * (number_of_classes + 1) > remaining
+        ) {
+            return {false, {}};
+        }
+
+        profile.number_of_classes = number_of_classes;
+        profile.visits.resize(number_of_states);
+        profile.transitions.resize(number_of_states * number_of_classes);
+
+        for (auto& count : profile.visits) {
+            read(count);
+        }
+        for (auto& count : profile.transitions) {
+            read(count);
+        }
+
+        return {true, std::move(profile)};
+    }
+
+    Dfa layout_dfa(const Dfa& dfa, const DfaProfile& profile) {
+        const auto number_of_states = dfa.get_number_of_states();
+        const auto number_of_classes = dfa.number_of_classes;
+
+        // Ties keep their old order, so the layout is deterministic.
+        std::vector<StateId> states(number_of_states - 1);
+        std::iota(states.begin(), states.end(), 1);
+        std::stable_sort(states.begin(), states.end(), [&](auto a, auto b) {
+            return profile.visits[a] > profile.visits[b];
+        });
+
+        std::vector<StateId> new_state(number_of_states);
+        new_state[Dfa::dead_state] = Dfa::dead_state;
+        for (std::size_t i = 0; i < states.size(); ++i) {
+            new_state[states[i]] = static_cast<StateId>(i + 1);
+        }
+
+        std::vector<std::uint64_t> class_counts(number_of_classes, 0);
+        for (std::size_t i = 0; i < profile.transitions.size(); ++i) {
+            class_counts[i % number_of_classes] += profile.transitions[i];
+        }
+
+        std::vector<std::uint8_t> classes(number_of_classes);
+        std::iota(classes.begin(), classes.end(), 0);
+        std::stable_sort(classes.begin(), classes.end(), [&](auto a, auto b) {
+            return class_counts[a] > class_counts[b];
+        });
+
+        std::vector<std::uint8_t> new_class(number_of_classes);
+        for (std::size_t i = 0; i < classes.size(); ++i) {
+            new_class[classes[i]] = static_cast<std::uint8_t>(i);
+        }
+
+        Dfa laid_out;
+        laid_out.number_of_classes = number_of_classes;
+        laid_out.transitions.resize(dfa.transitions.size());
+        laid_out.accepts.resize(number_of_states);
+
+        for (std::size_t byte = 0; byte < 256; ++byte) {
+            laid_out.byte_classes[byte] = new_class[dfa.byte_classes[byte]];
+        }
+
+        for (std::size_t state = 0; state < number_of_states; ++state) {
+            laid_out.accepts[new_state[state]] = dfa.accepts[state];
+
+            for (std::size_t c = 0; c < number_of_classes; ++c) {
+                laid_out.transitions[
+                    new_state[state] * number_of_classes + new_class[c]
+                ] = new_state[dfa.transitions[state * number_of_classes + c]];
+            }
+        }
+
+        for (auto start : dfa.starts) {
+            laid_out.starts.push_back(new_state[start]);
+        }
+
+        // The hot states are the shortest prefix that covers the required
+        // share of all visits; the dead state always counts as hot.
+        auto total = std::accumulate(
+            profile.visits.begin() + 1, profile.visits.end(), std::uint64_t {0}
+        );
+        std::uint64_t covered = 0;
+
+        laid_out.number_of_hot_states = 1;
+        for (auto state : states) {
+            if (covered >= hot_coverage * total || profile.visits[state] == 0) {
+                break;
+            }
+            covered += profile.visits[state];
+            ++laid_out.number_of_hot_states;
+        }
+
+        return laid_out;
+    }
+
+    void apply_profile(
+        Engine& engine, TokenSet& token_set, const DfaProfile& profile
+    ) {
+        if (profile.fingerprint != get_fingerprint(token_set.dfa) ||
+            profile.visits.size() != token_set.dfa.get_number_of_states() ||
+            profile.number_of_classes != token_set.dfa.number_of_classes
+        ) {
+            engine.report_warning(
+                "the profile was recorded on different token definitions "
+                "and is ignored"
+            );
+            return;
+        }
+
+        token_set.dfa = layout_dfa(token_set.dfa, profile);
+        token_set.encoded = encode_dfa(token_set.dfa);
+    }
+}
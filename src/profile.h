@@ -0,0 +1,55 @@
+#pragma once
+
+#include "lexer.cpp"
+#include "reader.h"
+
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace oclur {
+    // How often the lexer visited each DFA state and took each transition
+    // while tokenizing a training corpus. A profile only fits the DFA it
+    // was recorded on, which `fingerprint` identifies.
+    struct DfaProfile {
+        std::uint64_t fingerprint {0};
+        std::size_t number_of_classes {0};
+        std::vector<std::uint64_t> visits; // per state
+        // Laid out like Dfa::transitions.
+        std::vector<std::uint64_t> transitions;
+    };
+
+    [[nodiscard]] std::uint64_t get_fingerprint(const Dfa&);
+
+    // Records a profile by tokenizing corpora with a token set's lexer and
+    // replaying every scan of its DFA.
+    class DfaProfiler {
+    public:
+        DfaProfiler(const TokenSet&);
+
+        void train(std::string_view);
+
+        [[nodiscard]] const DfaProfile& get_profile() const;
+
+    private:
+        const TokenSet& token_set;
+        DfaProfile profile;
+    };
+
+    [[nodiscard]] bool save_profile(std::string_view, const DfaProfile&);
+    [[nodiscard]] std::pair<bool, DfaProfile> load_profile(std::string_view);
+
+    // The share of all visits that the hot states have to account for.
+    constexpr double hot_coverage = 0.99;
+
+    // Renumbers the states of a DFA hottest first, after the dead state, so
+    // the rows the lexer spends its time in share the first cache lines of
+    // the table and the never-visited states end up at the back. Byte
+    // classes are renumbered the same way, hottest column first.
+    [[nodiscard]] Dfa layout_dfa(const Dfa&, const DfaProfile&);
+
+    // Lays out the DFA of a compiled token set with a profile recorded on
+    // that same token set. Stale profiles are reported and ignored.
+    void apply_profile(Engine&, TokenSet&, const DfaProfile&);
+}
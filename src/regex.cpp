@@ -1,8 +1,10 @@
 #pragma once
 #include "regex.h"
 
+#include <string_view>
+
 namespace oclur {
-    RegexPtr convert_to_regex(std::string_view data) {
+    RegexPtr convert_to_regex(std::u32string_view data) {
         auto regex = std::make_shared<GroupingRegex>();
         for (const auto& ch : data) {
             auto subregex = std::make_shared<CharacterRegex>();
@@ -12,6 +14,62 @@ namespace oclur {
         return regex;
     }
 
+    // A canonical text form of a regex: the same for every spelling of the
+    // same regex, whatever its whitespace or raw/regex syntax.
+    std::string serialize_regex(const RegexPtr& regex) {
+        std::string text;
+
+        switch (regex->kind) {
+        case RegexKind::Character: {
+            auto character = std::static_pointer_cast<CharacterRegex>(regex);
+            text += "c" + std::to_string(character->value);
+            break;
+        }
+        case RegexKind::AnyCharacter: {
+            text += ".";
+            break;
+        }
+        case RegexKind::CharacterRange: {
+            auto range = std::static_pointer_cast<CharacterRangeRegex>(regex);
+            text += "r" + std::to_string(range->lower_bound) + 
+                "-" + std::to_string(range->upper_bound);
+            break;
+        }
+        case RegexKind::Grouping: {
+            auto grouping = std::static_pointer_cast<GroupingRegex>(regex);
+            text += "(";
+            for (const auto& item : grouping->items) {
+                text += serialize_regex(item);
+            }
+            text += ")";
+            break;
+        }
+        case RegexKind::OneOf: {
+            auto oneof = std::static_pointer_cast<OneOfRegex>(regex);
+            text += "[";
+            for (const auto& item : oneof->items) {
+                text += serialize_regex(item);
+            }
+            text += "]";
+            break;
+        }
+        case RegexKind::AnythingBut: {
+            auto anythingbut = 
+                std::static_pointer_cast<AnythingButRegex>(regex);
+            text += "^" + serialize_regex(anythingbut->regex);
+            break;
+        }
+        }
+
+        const auto& occurances = regex->occurances;
+        if (occurances.min != 1 || occurances.max != 1) {
+            text += "{" + std::to_string(occurances.min) + 
+                "," + std::to_string(occurances.max) + "}";
+        }
+
+        return text;
+    }
+
     RegexPtr combine_regex(RegexPtr a, RegexPtr b) {
         auto regex = std::make_shared<GroupingRegex>();
         regex->items.push_back(a);
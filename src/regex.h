@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace oclur {
@@ -18,8 +20,8 @@ namespace oclur {
             : kind(kind) {}
         RegexKind kind;
         struct {
-            size_t min {0};
-            size_t max {0}; // 0 means there is no upper limit
+            size_t min {1};
+            size_t max {1}; // 0 means there is no upper limit
         } occurances;
     };
 
@@ -34,14 +36,14 @@ namespace oclur {
     struct CharacterRegex : public Regex {
         CharacterRegex()
             : Regex(RegexKind::Character) {}
-        char value;
+        std::uint32_t value; // a code point
     };
 
     struct CharacterRangeRegex : public Regex {
         CharacterRangeRegex()
-            : Regex(RegexKind::Character) {}
-        char lower_bound;
-        char upper_bound;
+            : Regex(RegexKind::CharacterRange) {}
+        std::uint32_t lower_bound;
+        std::uint32_t upper_bound;
     };
 
     struct GroupingRegex : public Regex {
@@ -55,4 +57,6 @@ namespace oclur {
             : Regex(RegexKind::OneOf) {}
         std::vector<RegexPtr> items;
     };
+
+    [[nodiscard]] std::string serialize_regex(const RegexPtr&);
 }
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "ring.h"
+
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+namespace oclur {
+    template <typename T>
+    SpscRing<T>::SpscRing(std::size_t capacity)
+        : slots(std::bit_ceil(std::max<std::size_t>(capacity, 1))),
+          mask(slots.size() - 1) {}
+
+    template <typename T>
+    bool SpscRing<T>::try_push(T& value) {
+        auto tail = producer.tail.load(std::memory_order_relaxed);
+
+        if (tail - producer.cached_head == slots.size()) {
+            producer.cached_head =
+                consumer.head.load(std::memory_order_acquire);
+            if (tail - producer.cached_head == slots.size()) {
+                return false;
+            }
+        }
+
+        slots[tail & mask] = std::move(value);
+        producer.tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <typename T>
+    bool SpscRing<T>::try_pop(T& value) {
+        auto head = consumer.head.load(std::memory_order_relaxed);
+
+        if (head == consumer.cached_tail) {
+            consumer.cached_tail =
+                producer.tail.load(std::memory_order_acquire);
+            if (head == consumer.cached_tail) {
+                return false;
+            }
+        }
+
+        value = std::move(slots[head & mask]);
+        consumer.head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace oclur {
+    constexpr std::size_t cache_line_size = 64;
+
+    // A bounded lock-free queue between exactly one producer thread and one
+    // consumer thread. Each side owns one index and only reads the other's,
+    // keeping a cached copy of it so the shared cache line is only touched
+    // when the ring looks full or empty.
+    template <typename T>
+    class SpscRing {
+    public:
+        // The capacity is rounded up to a power of two.
+        SpscRing(std::size_t);
+
+        // Both leave `value` untouched when they fail.
+        [[nodiscard]] bool try_push(T& value);
+        [[nodiscard]] bool try_pop(T& value);
+
+    private:
+        std::vector<T> slots;
+        std::size_t mask;
+
+        struct alignas(cache_line_size) {
+            std::atomic<std::size_t> tail {0};
+            std::size_t cached_head {0};
+        } producer;
+
+        struct alignas(cache_line_size) {
+            std::atomic<std::size_t> head {0};
+            std::size_t cached_tail {0};
+        } consumer;
+    };
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "stream.h"
+
+#include <atomic>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace oclur {
+    template <typename Consumer>
+    void lex_pipelined(
+        const Lexer& lexer,
+        std::string_view data,
+        Consumer&& consume,
+        std::size_t batch_size
+    ) {
+        SpscRing<std::vector<Token>> filled(pipeline_depth);
+        SpscRing<std::vector<Token>> recycled(pipeline_depth);
+        std::atomic<bool> done {false};
+
+        // Stops waiting for room if the consumer bailed out with an
+        // exception, since the jthread is then joined while the ring stays
+        // full.
+        std::jthread producer([&](std::stop_token stop) {
+            for (auto batch : lexer.stream(data, batch_size)) {
+                std::vector<Token> buffer;
+                (void)recycled.try_pop(buffer);
+                buffer.assign(batch.begin(), batch.end());
+
+                while (!filled.try_push(buffer)) {
+                    if (stop.stop_requested()) {
+                        return;
+                    }
+                    std::this_thread::yield();
+                }
+            }
+            done.store(true, std::memory_order_release);
+        });
+
+        std::vector<Token> buffer;
+
+        for (;;) {
+            if (filled.try_pop(buffer)) {
+                consume(std::span<const Token>(buffer));
+                buffer.clear();
+                (void)recycled.try_push(buffer);
+                continue;
+            }
+
+            // Batches pushed before `done` was set are visible once it is.
+            if (done.load(std::memory_order_acquire)) {
+                while (filled.try_pop(buffer)) {
+                    consume(std::span<const Token>(buffer));
+                }
+                break;
+            }
+
+            std::this_thread::yield();
+        }
+    }
+}
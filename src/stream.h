@@ -0,0 +1,25 @@
+#pragma once
+
+#include "lexer.cpp"
+#include "ring.cpp"
+
+#include <span>
+#include <string_view>
+
+namespace oclur {
+    // Batches in flight between the lexing thread and the consumer.
+    constexpr std::size_t pipeline_depth = 8;
+
+    // Lexes `data` on a separate thread while `consume` is called on the
+    // calling thread with each batch of tokens as soon as it is ready.
+    // Filled batches reach the consumer through one SPSC ring and their
+    // buffers come back through another, so a steady stream does not
+    // allocate. Returns once every batch has been consumed.
+    template <typename Consumer>
+    void lex_pipelined(
+        const Lexer&, 
+        std::string_view, 
+        Consumer&& consume,
+        std::size_t batch_size = default_batch_size
+    );
+}
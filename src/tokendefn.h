@@ -4,11 +4,31 @@
 
 #include <memory>
 #include <map>
+#include <string_view>
+#include <vector>
 
 namespace oclur {    
+    // Tokens defined outside of any 'mode' block belong to this mode, which
+    // is also the one lexing starts in.
+    constexpr std::string_view initial_mode = "initial";
+
+    enum class ModeAction {
+        None,
+        Push,
+        Pop
+    };
+
     struct TokenDefn {
         std::string name;
         RegexPtr regex;
+        std::size_t id {0}; // definition order; earlier tokens win ties
+
+        std::vector<std::string> modes; // the lexer modes it is matched in
+
+        struct {
+            ModeAction kind {ModeAction::None};
+            std::string mode; // the mode pushed
+        } action;
     };
 
     using TokenDefnPtr = std::shared_ptr<TokenDefn>;
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "tokenset.h"
+
+#include <algorithm>
+
+namespace oclur {
+    TokenSetBuilder::TokenSetBuilder(Engine& engine)
+        : engine(engine) {
+        get_mode(std::string(initial_mode));
+    }
+
+    std::size_t TokenSetBuilder::get_mode(const std::string& name) {
+        if (auto found = mode_ids.find(name); found != mode_ids.end()) {
+            return found->second;
+        }
+
+        auto id = token_set.modes.size();
+        token_set.modes.push_back(name);
+        mode_ids.insert({name, id});
+
+        nfa.states.emplace_back();
+        starts.push_back(nfa.states.size() - 1);
+
+        token_set.counted.states.emplace_back();
+        token_set.counted_starts.push_back(token_set.counted.states.size() - 1);
+
+        return id;
+    }
+
+    void TokenSetBuilder::add(
+        TokenId id, const TokenDefn& defn, const Nfa& fragment
+    ) {
+        auto modes = declare(id, defn);
+
+        auto counted = !fragment.counters.empty();
+        auto& target = counted ? token_set.counted : nfa;
+        auto start = append_nfa(target, fragment, id);
+
+        for (auto mode : modes) {
+            auto mode_start = counted 
+                ? token_set.counted_starts[mode] 
+                : starts[mode];
+            target.states[mode_start].epsilons.push_back(start);
+        }
+    }
+
+    std::vector<std::size_t> TokenSetBuilder::declare(
+        TokenId id, const TokenDefn& defn
+    ) {
+        if (token_set.names.size() <= id) {
+            token_set.names.resize(id + 1);
+            token_set.actions.resize(id + 1);
+        }
+        token_set.names[id] = defn.name;
+        token_set.actions[id].kind = defn.action.kind;
+
+        if (defn.action.kind == ModeAction::Push) {
+            pushes.push_back({id, defn.action.mode});
+        }
+
+        std::vector<std::size_t> modes;
+        for (const auto& mode : defn.modes) {
+            modes.push_back(get_mode(mode));
+        }
+        std::sort(modes.begin(), modes.end());
+        modes.erase(std::unique(modes.begin(), modes.end()), modes.end());
+
+        return modes;
+    }
+
+    const std::vector<std::string>& TokenSetBuilder::get_modes() const {
+        return token_set.modes;
+    }
+
+    // Pushed modes are resolved last, since a mode may be pushed before any
+    // of its tokens are defined.
+    void TokenSetBuilder::resolve_pushes() {
+        for (const auto& [id, mode] : pushes) {
+            auto found = mode_ids.find(mode);
+            if (found == mode_ids.end()) {
+                engine.report_fatal_error(
+                    "token '",
+                    token_set.names[id],
+                    "' pushes mode '",
+                    mode,
+                    "', which has no tokens"
+                );
+            }
+            token_set.actions[id].mode = found->second;
+        }
+    }
+
+    TokenSet TokenSetBuilder::build() {
+        return build(minimize_dfa(DfaBuilder(nfa, starts).build()));
+    }
+
+    TokenSet TokenSetBuilder::build(Dfa&& dfa) {
+        resolve_pushes();
+
+        CountingMatcher matcher(token_set.counted);
+        for (auto start : token_set.counted_starts) {
+            token_set.counted_first_bytes.push_back(
+                matcher.get_first_bytes(start)
+            );
+        }
+
+        token_set.dfa = std::move(dfa);
+        token_set.encoded = encode_dfa(token_set.dfa);
+        return std::move(token_set);
+    }
+
+    TokenSet compile_token_set(Engine& engine, const TokenDefnMap& defns) {
+        std::vector<TokenDefnPtr> ordered;
+        for (const auto& [_, defn] : defns) {
+            ordered.push_back(defn);
+        }
+        std::sort(ordered.begin(), ordered.end(), [](auto& a, auto& b) {
+            return a->id < b->id;
+        });
+
+        TokenSetBuilder builder(engine);
+
+        for (const auto& defn : ordered) {
+            builder.add(defn->id, *defn, NfaBuilder(engine).build(*defn));
+        }
+
+        return builder.build();
+    }
+}
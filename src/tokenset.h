@@ -0,0 +1,74 @@
+#pragma once
+
+#include "dfa.cpp"
+#include "encoding.cpp"
+#include "counting.cpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace oclur {
+    struct TokenAction {
+        ModeAction kind {ModeAction::None};
+        std::size_t mode {0}; // the mode pushed
+    };
+
+    // A token set compiled down to a single DFA with one start state per
+    // lexer mode. Token ids index `names` and `actions` and follow
+    // definition order; mode 0 is the initial mode. Tokens that needed
+    // counters cannot be determinized and live in `counted` instead, which
+    // has its own start state per mode, and are only simulated where the
+    // input starts with one of the mode's `counted_first_bytes`. The lexer
+    // steps through `encoded`, which has to be rebuilt whenever `dfa`
+    // changes.
+    struct TokenSet {
+        std::vector<std::string> names;
+        std::vector<TokenAction> actions;
+        std::vector<std::string> modes;
+
+        Dfa dfa;
+        EncodedDfa encoded;
+        Nfa counted;
+        std::vector<std::size_t> counted_starts;
+        std::vector<ByteSet> counted_first_bytes;
+
+        [[nodiscard]] bool has_counted_tokens() const {
+            return !counted.counters.empty();
+        }
+    };
+
+    // Links per-definition NFA fragments into a token set.
+    class TokenSetBuilder {
+    public:
+        TokenSetBuilder(Engine&);
+
+        void add(TokenId, const TokenDefn&, const Nfa&);
+
+        // Adds a definition whose NFA the caller determinizes itself, and
+        // returns the ids of the modes it is matched in.
+        std::vector<std::size_t> declare(TokenId, const TokenDefn&);
+
+        [[nodiscard]] const std::vector<std::string>& get_modes() const;
+
+        [[nodiscard]] TokenSet build();
+
+        // Builds the token set around a DFA the caller determinized, with
+        // one start state per mode from get_modes().
+        [[nodiscard]] TokenSet build(Dfa&&);
+
+    private:
+        std::size_t get_mode(const std::string&);
+        void resolve_pushes();
+
+        Engine& engine;
+        TokenSet token_set;
+        std::map<std::string, std::size_t> mode_ids;
+        std::vector<std::pair<TokenId, std::string>> pushes;
+
+        Nfa nfa;
+        std::vector<std::size_t> starts;
+    };
+
+    [[nodiscard]] TokenSet compile_token_set(Engine&, const TokenDefnMap&);
+}
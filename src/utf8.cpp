@@ -0,0 +1,210 @@
+#pragma once
+
+#include "utf8.h"
+
+#include <algorithm>
+
+namespace oclur {
+    constexpr std::uint32_t surrogates_lower = 0xd800;
+    constexpr std::uint32_t surrogates_upper = 0xdfff;
+
+    CodePointSet normalize_code_points(CodePointSet set) {
+        std::sort(set.begin(), set.end(), [](const auto& a, const auto& b) {
+            return a.lower < b.lower;
+        });
+
+        CodePointSet merged;
+        for (auto range : set) {
+            range.upper = std::min(range.upper, max_code_point);
+            if (range.lower > range.upper) {
+                continue;
+            }
+            if (!merged.empty() && range.lower <= merged.back().upper + 1) {
+                merged.back().upper =
+                    std::max(merged.back().upper, range.upper);
+                continue;
+            }
+            merged.push_back(range);
+        }
+
+        CodePointSet normalized;
+        for (auto range : merged) {
+            if (range.upper < surrogates_lower ||
+                range.lower > surrogates_upper
+            ) {
+                normalized.push_back(range);
+                continue;
+            }
+            if (range.lower < surrogates_lower) {
+                normalized.push_back({range.lower, surrogates_lower - 1});
+            }
+            if (range.upper > surrogates_upper) {
+                normalized.push_back({surrogates_upper + 1, range.upper});
+            }
+        }
+
+        return normalized;
+    }
+
+    CodePointSet complement_code_points(const CodePointSet& set) {
+        CodePointSet complement;
+        std::uint32_t next = 0;
+
+        for (const auto& range : normalize_code_points(set)) {
+            if (range.lower > next) {
+                complement.push_back({next, range.lower - 1});
+            }
+            next = range.upper + 1;
+        }
+
+        if (next <= max_code_point) {
+            complement.push_back({next, max_code_point});
+        }
+
+        return normalize_code_points(std::move(complement));
+    }
+
+    // Ranges are split until both ends encode to the same number of bytes
+    // and every continuation byte spans its full 0x80-0xbf range below the
+    // first byte that differs; each byte then varies independently.
+    std::vector<Utf8Sequence> get_utf8_sequences(const CodePointSet& set) {
+        std::vector<Utf8Sequence> sequences;
+        std::vector<CodePointRange> pending(set.rbegin(), set.rend());
+
+        while (!pending.empty()) {
+            auto [lower, upper] = pending.back();
+            pending.pop_back();
+
+            bool split = false;
+
+            for (std::uint32_t boundary : {0x7fu, 0x7ffu, 0xffffu}) {
+                if (lower <= boundary && boundary < upper) {
+                    pending.push_back({boundary + 1, upper});
+                    pending.push_back({lower, boundary});
+                    split = true;
+                    break;
+                }
+            }
+
+            // Single bytes need no further splitting.
+            for (std::uint32_t i = 1; !split && upper >= 0x80 && i < 4; ++i) {
+                std::uint32_t mask = (1u << (6 * i)) - 1;
+
+                if ((lower & ~mask) == (upper & ~mask)) {
+                    continue;
+                }
+                if ((lower & mask) != 0) {
+                    pending.push_back({(lower | mask) + 1, upper});
+                    pending.push_back({lower, lower | mask});
+                    split = true;
+                }
+                else if ((upper & mask) != mask) {
+                    pending.push_back({upper & ~mask, upper});
+                    pending.push_back({lower, (upper & ~mask) - 1});
+                    split = true;
+                }
+            }
+
+            if (split) {
+                continue;
+            }
+
+            auto encoded_lower = encode_utf8(lower);
+            auto encoded_upper = encode_utf8(upper);
+
+            Utf8Sequence sequence;
+            for (std::size_t i = 0; i < encoded_lower.size(); ++i) {
+                sequence.push_back({
+                    static_cast<std::uint8_t>(encoded_lower[i]),
+                    static_cast<std::uint8_t>(encoded_upper[i])
+                });
+            }
+            sequences.push_back(std::move(sequence));
+        }
+
+        return sequences;
+    }
+
+    std::string encode_utf8(std::uint32_t code_point) {
+        std::string encoded;
+
+        if (code_point < 0x80) {
+            encoded += static_cast<char>(code_point);
+        }
+        else if (code_point < 0x800) {
+            encoded += static_cast<char>(0xc0 | (code_point >> 6));
+            encoded += static_cast<char>(0x80 | (code_point & 0x3f));
+        }
+        else if (code_point < 0x10000) {
+            encoded += static_cast<char>(0xe0 | (code_point >> 12));
+            encoded += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+            encoded += static_cast<char>(0x80 | (code_point & 0x3f));
+        }
+        else {
+            encoded += static_cast<char>(0xf0 | (code_point >> 18));
+            encoded += static_cast<char>(0x80 | ((code_point >> 12) & 0x3f));
+            encoded += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+            encoded += static_cast<char>(0x80 | (code_point & 0x3f));
+        }
+
+        return encoded;
+    }
+
+    std::pair<std::uint32_t, std::size_t> decode_utf8(
+        std::string_view data, std::size_t offset
+    ) {
+        auto byte = [&](std::size_t i) -> std::uint32_t {
+            return static_cast<std::uint8_t>(data[offset + i]);
+        };
+
+        auto first = byte(0);
+
+        if (first < 0x80) {
+            return {first, 1};
+        }
+
+        std::size_t length = 0;
+        std::uint32_t code_point = 0;
+        std::uint32_t minimum = 0;
+
+        if ((first & 0xe0) == 0xc0) {
+            length = 2;
+            code_point = first & 0x1f;
+            minimum = 0x80;
+        }
+        else if ((first & 0xf0) == 0xe0) {
+            length = 3;
+            code_point = first & 0x0f;
+            minimum = 0x800;
+        }
+        else if ((first & 0xf8) == 0xf0) {
+            length = 4;
+            code_point = first & 0x07;
+            minimum = 0x10000;
+        }
+        else {
+            return {0, 0};
+        }
+
+        if (offset + length > data.size()) {
+            return {0, 0};
+        }
+
+        for (std::size_t i = 1; i < length; ++i) {
+            if ((byte(i) & 0xc0) != 0x80) {
+                return {0, 0};
+            }
+            code_point = (code_point << 6) | (byte(i) & 0x3f);
+        }
+
+        // Overlong encodings, surrogates and values past the last code point
+        // are all invalid.
+        if (code_point < minimum || code_point > max_code_point ||
+            (code_point >= surrogates_lower && code_point <= surrogates_upper)
+        ) {
+            return {0, 0};
+        }
+
+        return {code_point, length};
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace oclur {
+    constexpr std::uint32_t max_code_point = 0x10ffff;
+
+    struct CodePointRange {
+        std::uint32_t lower;
+        std::uint32_t upper;
+    };
+
+    // Sorted, non-overlapping and never containing surrogates, which have no
+    // UTF-8 encoding.
+    using CodePointSet = std::vector<CodePointRange>;
+
+    struct ByteRange {
+        std::uint8_t lower;
+        std::uint8_t upper;
+    };
+
+    // Matches one encoded code point: one byte range per encoded byte.
+    using Utf8Sequence = std::vector<ByteRange>;
+
+    [[nodiscard]] CodePointSet normalize_code_points(CodePointSet);
+    [[nodiscard]] CodePointSet complement_code_points(const CodePointSet&);
+
+    // Splits a set into byte-range sequences that together match exactly
+    // the UTF-8 encodings of its code points.
+    [[nodiscard]]
+    std::vector<Utf8Sequence> get_utf8_sequences(const CodePointSet&);
+
+    [[nodiscard]] std::string encode_utf8(std::uint32_t);
+
+    // Decodes the code point starting at `offset`, returning it and its
+    // encoded length, or a length of 0 if the bytes there are not valid
+    // UTF-8.
+    [[nodiscard]] std::pair<std::uint32_t, std::size_t> decode_utf8(
+        std::string_view, std::size_t
+    );
+}
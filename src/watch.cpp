@@ -0,0 +1,300 @@
+#pragma once
+
+#include "watch.h"
+#include "reader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <set>
+#include <thread>
+#include <unordered_set>
+
+namespace oclur {
+    const TokenSet& IncrementalCompiler::compile(std::string_view filepath) {
+        auto [fileread, filedata] = read_file(filepath);
+
+        if (!fileread) {
+            engine.report_fatal_error(
+                "could not open input file '",
+                filepath,
+                "'"
+            );
+        }
+
+        file = filepath;
+        statistics = Statistics {};
+
+        auto updated = update_blocks(filepath, filedata);
+        auto built = build_token_set(updated);
+
+        // Nothing is replaced until the whole file compiled, so an error
+        // leaves the last good state behind.
+        blocks = std::move(updated);
+        data = std::move(filedata);
+        token_set = std::move(built);
+        drop_unused_fragments();
+
+        return get_token_set();
+    }
+
+    const TokenSet& IncrementalCompiler::get_token_set() const {
+        return token_set;
+    }
+
+    const IncrementalCompiler::Statistics&
+    IncrementalCompiler::get_statistics() const {
+        return statistics;
+    }
+
+    // Blocks that end inside the unchanged prefix are kept as they are.
+    // Parsing restarts after the last of them and stops at the first block
+    // boundary that also was a block boundary inside the unchanged suffix.
+    std::vector<IncrementalCompiler::Block> IncrementalCompiler::update_blocks(
+        std::string_view filepath, const std::string& new_data
+    ) {
+        const auto old_size = data.size();
+        const auto new_size = new_data.size();
+        const auto limit = std::min(old_size, new_size);
+
+        std::size_t prefix = std::mismatch(
+            data.begin(), data.begin() + limit, new_data.begin()
+        ).first - data.begin();
+
+        std::size_t suffix = std::mismatch(
+            data.rbegin(), data.rbegin() + (limit - prefix), new_data.rbegin()
+        ).first - data.rbegin();
+
+        auto kept = std::partition_point(
+            blocks.begin(), blocks.end(),
+            [&](const Block& block) {
+                return block.offset + block.length <= prefix;
+            }
+        );
+
+        std::vector<Block> updated(blocks.begin(), kept);
+        auto old_index = static_cast<std::size_t>(kept - blocks.begin());
+
+        std::size_t position = updated.empty()
+            ? 0
+            : updated.back().offset + updated.back().length;
+
+        Location location;
+        location.file = filepath;
+        location.line += std::count(
+            new_data.begin(), new_data.begin() + position, '\n'
+        );
+
+        auto line_start = new_data.rfind(
+            '\n', position == 0 ? 0 : position - 1
+        );
+        line_start = (line_start == std::string::npos) ? 0 : line_start + 1;
+
+        auto advance_to = [&](std::size_t end) {
+            for (; position < end; ++position) {
+                if (new_data[position] == '\n') {
+                    location.line++;
+                    line_start = position + 1;
+                }
+            }
+        };
+
+        while (true) {
+            auto next = position;
+            while (next < new_size && std::isspace(
+                static_cast<unsigned char>(new_data[next])
+            )) {
+                ++next;
+            }
+            advance_to(next);
+
+            if (position == new_size) {
+                break;
+            }
+
+            if (position >= new_size - suffix) {
+                auto old_position = position - new_size + old_size;
+
+                while (old_index < blocks.size() &&
+                    blocks[old_index].offset < old_position
+                ) {
+                    ++old_index;
+                }
+
+                if (old_index < blocks.size() &&
+                    blocks[old_index].offset == old_position
+                ) {
+                    for (; old_index < blocks.size(); ++old_index) {
+                        auto block = blocks[old_index];
+                        block.offset = block.offset - old_size + new_size;
+                        updated.push_back(std::move(block));
+                    }
+                    break;
+                }
+            }
+
+            location.column = position - line_start + 1;
+
+            auto [defns, end] = parser.parse_block_at(
+                new_data, position, location
+            );
+            statistics.reparsed_blocks++;
+
+            Block block;
+            block.offset = position;
+            block.length = end - position;
+            block.defns = std::move(defns);
+            for (const auto& defn : block.defns) {
+                block.fragments.push_back(get_fragment(*defn));
+            }
+
+            updated.push_back(std::move(block));
+            advance_to(end);
+        }
+
+        return updated;
+    }
+
+    // Fragments are keyed on the regex rather than the text that spelled
+    // it, so edits to whitespace, names or actions reuse the NFA. The modes
+    // are part of the key, since a fragment accepts one token per compile.
+    IncrementalCompiler::FragmentPtr IncrementalCompiler::get_fragment(
+        const TokenDefn& defn
+    ) {
+        auto key = serialize_regex(defn.regex);
+
+        std::set<std::string_view> modes(defn.modes.begin(), defn.modes.end());
+        for (auto mode : modes) {
+            key += ' ';
+            key += mode;
+        }
+
+        if (auto found = fragments.find(key); found != fragments.end()) {
+            return found->second;
+        }
+
+        auto fragment = std::make_shared<Fragment>();
+        fragment->nfa = NfaBuilder(engine).build(defn);
+        if (!fragment->is_counted()) {
+            fragment->start = dfa_builder.link(fragment->nfa);
+        }
+        statistics.rebuilt_fragments++;
+
+        fragments.insert({std::move(key), fragment});
+        return fragment;
+    }
+
+    TokenSet IncrementalCompiler::build_token_set(
+        const std::vector<Block>& blocks
+    ) {
+        std::unordered_set<std::string_view> names;
+        TokenSetBuilder builder(engine);
+        std::vector<std::vector<IncrementalDfaBuilder::Link>> links; // by mode
+
+        for (const auto& block : blocks) {
+            for (std::size_t i = 0; i < block.defns.size(); ++i) {
+                const auto& defn = *block.defns[i];
+
+                if (auto [_, inserted] = names.insert(defn.name);
+                    !inserted
+                ) {
+                    engine.report_fatal_error(
+                        "in file '",
+                        file,
+                        "': redefinition of token: ",
+                        defn.name
+                    );
+                }
+
+                TokenId id = names.size() - 1;
+                const auto& fragment = *block.fragments[i];
+
+                if (fragment.is_counted()) {
+                    builder.add(id, defn, fragment.nfa);
+                    continue;
+                }
+
+                for (auto mode : builder.declare(id, defn)) {
+                    if (links.size() <= mode) {
+                        links.resize(mode + 1);
+                    }
+                    links[mode].push_back({fragment.start, id});
+                }
+            }
+        }
+
+        links.resize(builder.get_modes().size());
+        auto dfa = dfa_builder.build(links);
+        statistics.explored_states = dfa_builder.get_number_of_explored_sets();
+
+        return builder.build(std::move(dfa));
+    }
+
+    // Unlinked fragments leave their NFA states behind; once those are the
+    // majority, every fragment is linked into a fresh builder.
+    void IncrementalCompiler::drop_unused_fragments() {
+        std::erase_if(fragments, [&](const auto& entry) {
+            const auto& fragment = *entry.second;
+            if (entry.second.use_count() > 1) {
+                return false;
+            }
+            if (!fragment.is_counted()) {
+                dfa_builder.unlink(fragment.start);
+            }
+            return true;
+        });
+
+        if (dfa_builder.get_number_of_unlinked_states() > 
+            dfa_builder.get_number_of_linked_states()
+        ) {
+            dfa_builder = IncrementalDfaBuilder {};
+            for (auto& [_, fragment] : fragments) {
+                if (!fragment->is_counted()) {
+                    fragment->start = dfa_builder.link(fragment->nfa);
+                }
+            }
+        }
+    }
+
+    void watch(Engine& engine, std::string_view filepath) {
+        IncrementalCompiler compiler(engine);
+        std::filesystem::file_time_type last_write_time;
+
+        engine.set_fatal_errors_recoverable(true);
+
+        while (true) {
+            std::error_code error;
+            auto write_time = std::filesystem::last_write_time(filepath, error);
+
+            if (!error && write_time != last_write_time) {
+                last_write_time = write_time;
+
+                try {
+                    auto started = std::chrono::steady_clock::now();
+                    const auto& token_set = compiler.compile(filepath);
+                    auto elapsed = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - started
+                    );
+
+                    const auto& statistics = compiler.get_statistics();
+                    std::cout
+                        << token_set.names.size() << " token(s), "
+                        << token_set.dfa.get_number_of_states() << " state(s); "
+                        << statistics.reparsed_blocks << " block(s) re-parsed, "
+                        << statistics.rebuilt_fragments
+                        << " fragment(s) rebuilt, "
+                        << statistics.explored_states
+                        << " state(s) explored in "
+                        << elapsed.count() << "ms" << std::endl;
+                }
+                catch (const FatalError&) {
+                    std::cout
+                        << "keeping the last token set that compiled"
+                        << std::endl;
+                }
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+}
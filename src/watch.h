@@ -0,0 +1,82 @@
+#pragma once
+
+#include "parser.cpp"
+#include "tokenset.cpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace oclur {
+    // Recompiles a definition file after edits, re-parsing only the 'def'
+    // and 'mode' blocks in the changed region and reusing the NFA of every
+    // definition whose regex it has already seen. The NFAs stay linked
+    // between compiles, so determinization only explores the DFA states
+    // that involve changed definitions. The DFA is not minimized. A compile
+    // that fails leaves the last token set that compiled in place.
+    class IncrementalCompiler {
+    public:
+        IncrementalCompiler(Engine& engine)
+            : engine(engine), parser(engine) {}
+
+        const TokenSet& compile(std::string_view);
+
+        [[nodiscard]] const TokenSet& get_token_set() const;
+
+        struct Statistics {
+            std::size_t reparsed_blocks {0};
+            std::size_t rebuilt_fragments {0};
+            std::size_t explored_states {0};
+        };
+
+        [[nodiscard]] const Statistics& get_statistics() const;
+
+    private:
+        // The NFA of a regex, shared by every definition that spells it in
+        // the same modes. Fragments with counters are linked anew by every
+        // compile; the others are linked once into the DFA builder.
+        struct Fragment {
+            Nfa nfa;
+            std::size_t start {0}; // in the DFA builder
+
+            [[nodiscard]] bool is_counted() const {
+                return !nfa.counters.empty();
+            }
+        };
+
+        using FragmentPtr = std::shared_ptr<Fragment>;
+
+        // The definitions of one 'def' or 'mode' block and their NFAs.
+        struct Block {
+            std::size_t offset;
+            std::size_t length;
+            std::vector<TokenDefnPtr> defns;
+            std::vector<FragmentPtr> fragments;
+        };
+
+        [[nodiscard]] std::vector<Block> update_blocks(
+            std::string_view, const std::string&
+        );
+        [[nodiscard]] FragmentPtr get_fragment(const TokenDefn&);
+        [[nodiscard]] TokenSet build_token_set(const std::vector<Block>&);
+        void drop_unused_fragments();
+
+        Engine& engine;
+        Parser parser;
+
+        std::string file;
+        std::string data;
+        std::vector<Block> blocks;
+        std::unordered_map<std::string, FragmentPtr> fragments; // by regex
+        IncrementalDfaBuilder dfa_builder;
+
+        TokenSet token_set;
+        Statistics statistics;
+    };
+
+    // Recompiles the file every time it changes on disk, reporting errors
+    // without stopping. Never returns.
+    void watch(Engine&, std::string_view);
+}